@@ -0,0 +1,600 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Throughput benchmark of the pixel conversion and scaling kernels of the capture filter
+//Every job runs with each resolution offered by the filter as its output size, with contiguous and padded source rows and
+//on 1 to N threads (on the worker pool of the filter which splits them into chunks of rows), every run gets checked against the scalar kernels
+//Build from a Visual Studio command prompt with: cl /O2 /W3 /EHsc UnityCaptureBenchmark.cpp
+//Or on Linux with: g++ -O2 -std=c++11 -pthread UnityCaptureBenchmark.cpp -o UnityCaptureBenchmark
+//A full run takes a while, it can be narrowed down with the optional arguments: a part of a job name, a resolution like 1920x1080
+//and -t followed by the maximum number of threads (which defaults to the number of logical processors)
+//With -s every job also collects frame statistics (which get checked against the scalar kernels and the output size as well)
+//At the end the non-temporal stores and the hashing of source tiles (used to skip unchanged rows) get measured by frame size
+
+#include "shared.inl"
+#ifdef _WIN32
+static size_t GetLastLevelCacheSize() { return SharedImageMemory::GetLastLevelCacheSize(); }
+#else
+#include <unistd.h>
+static size_t GetLastLevelCacheSize() { long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE); return (l3 > 0 ? (size_t)l3 : (l2 > 0 ? (size_t)l2 : ((size_t)8 << 20))); }
+#endif
+#include "process.inl"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct BenchCase
+{
+	const char* Name;
+	ProcessJob::EInput In;
+	ProcessJob::EOutput Out;
+	int InMul, InDiv; //source size relative to the output size
+	int ResizeMode; //ResizeCoeffs::EFilter used when the sizes differ
+	bool Mirror, VFlip, Rotate, Composite;
+	ProcessJob::EAlpha AlphaMode;
+	ProcessJob::ETransfer Transfer; //HDR curve for linear FP16 sources (the tables are then used by all kernels like in the filter), TRANSFER_GAMMA for none
+};
+
+static const BenchCase Cases[] =
+{
+	{ "Convert RGBA8 to BGR",                  ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to BGRA",                 ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to BGR mirrored",         ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  1, 1, 0,                            true,  false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to BGRA flipped",         ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, true,  false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 sRGB to BGR",              ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 gamma to BGRA mirrored",   ProcessJob::IN_RGBA16_GAMMA,    ProcessJob::OUT_BGRA, 1, 1, 0,                            true,  false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Copy BGRA8 to BGRA",                    ProcessJob::IN_BGRA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Copy BGRA8 to BGRA mirrored",           ProcessJob::IN_BGRA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            true,  false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGB10A2 to BGR",                ProcessJob::IN_RGB10A2_GAMMA,   ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGB10A2 linear to BGR",         ProcessJob::IN_RGB10A2_SRGB,    ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert R11G11B10F linear to BGR",      ProcessJob::IN_R11G11B10F_SRGB, ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP32 linear to BGR",            ProcessJob::IN_RGBA32F_SRGB,    ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x RGBA8 to BGR (box)",       ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  2, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x RGBA8 to BGR (linear)",    ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  2, 1, ResizeCoeffs::FILTER_LINEAR,  false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x FP16 sRGB (box)",          ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_BGR,  2, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 3x RGBA8 to BGR (box)",       ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  3, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 4x RGBA8 to BGR (box)",       ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  4, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x RGBA8 to BGR (lanczos)",   ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  2, 1, ResizeCoeffs::FILTER_LANCZOS, false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Resize 1.5x down (linear)",             ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  3, 2, ResizeCoeffs::FILTER_LINEAR,  false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Resize 1.5x up (lanczos)",              ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  2, 3, ResizeCoeffs::FILTER_LANCZOS, false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Resize 1.5x down mirrored (linear)",    ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 3, 2, ResizeCoeffs::FILTER_LINEAR,  true,  true,  false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to NV12",                 ProcessJob::IN_RGBA8,           ProcessJob::OUT_NV12, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to YUY2",                 ProcessJob::IN_RGBA8,           ProcessJob::OUT_YUY2, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to I420",                 ProcessJob::IN_RGBA8,           ProcessJob::OUT_I420, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to NV12 mirrored",        ProcessJob::IN_RGBA8,           ProcessJob::OUT_NV12, 1, 1, 0,                            true,  true,  false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 sRGB to NV12",             ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_NV12, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x RGBA8 to NV12 (box)",      ProcessJob::IN_RGBA8,           ProcessJob::OUT_NV12, 2, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Resize 1.5x down NV12 (linear)",        ProcessJob::IN_RGBA8,           ProcessJob::OUT_NV12, 3, 2, ResizeCoeffs::FILTER_LINEAR,  false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 sRGB to P010",             ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_P010, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 gamma to Y210",            ProcessJob::IN_RGBA16_GAMMA,    ProcessJob::OUT_Y210, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 linear to P010 (PQ)",      ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_P010, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_PQ },
+	{ "Resize 1.5x down to P010 (HLG)",        ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_P010, 3, 2, ResizeCoeffs::FILTER_LINEAR,  false, false, false, false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_HLG },
+	{ "Rotate 90 RGBA8 to BGRA",               ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, true,  false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Rotate 90 FP16 sRGB to BGRA",           ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, true,  false, ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Composite RGBA8 over image to BGR",     ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, true,  ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Composite FP16 sRGB over image to BGR", ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_BGR,  1, 1, 0,                            false, false, false, true,  ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Downscale 2x composite to BGR (box)",   ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGR,  2, 1, ResizeCoeffs::FILTER_AREA,    false, false, false, true,  ProcessJob::ALPHA_KEEP,          ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to BGRA premultiplied",   ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_PREMULTIPLY,   ProcessJob::TRANSFER_GAMMA },
+	{ "Convert RGBA8 to BGRA unpremultiplied", ProcessJob::IN_RGBA8,           ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_UNPREMULTIPLY, ProcessJob::TRANSFER_GAMMA },
+	{ "Convert FP16 sRGB to BGRA unpremult.",  ProcessJob::IN_RGBA16_SRGB,     ProcessJob::OUT_BGRA, 1, 1, 0,                            false, false, false, false, ProcessJob::ALPHA_UNPREMULTIPLY, ProcessJob::TRANSFER_GAMMA },
+};
+
+//Resolutions offered by the capture filter (the _media list in UnityCaptureFilter.cpp), used as the output size of every job
+static const int Resolutions[][2] =
+{
+	{ 1920, 1080 }, { 1280,  720 }, {  960,  540 }, {  640,  360 }, {  480,  270 }, {  256,  144 }, { 2560, 1440 }, { 3840, 2160 },
+	{ 1440, 1080 }, {  960,  720 }, {  640,  480 }, {  480,  360 }, {  320,  240 }, {  192,  144 }, { 1920, 1440 }, { 2880, 2160 },
+	{ 1920, 1200 }, { 1280,  800 }, { 2880, 1800 }, { 2560, 1600 }, { 1680, 1050 }, { 1440,  900 },
+};
+
+static double Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int InputBPP(ProcessJob::EInput In)
+{
+	return (In == ProcessJob::IN_RGBA16_GAMMA || In == ProcessJob::IN_RGBA16_SRGB ? 8 : (In == ProcessJob::IN_RGBA32F_GAMMA || In == ProcessJob::IN_RGBA32F_SRGB ? 16 : 4));
+}
+
+static size_t OutputSize(ProcessJob::EOutput Out, size_t Width, size_t Height)
+{
+	//Bytes per pixel times two in the order of ProcessJob::EOutput (BGR, BGRA, NV12, YUY2, I420, P010, Y210)
+	static const int HalfBytes[] = { 6, 8, 3, 4, 3, 6, 8 };
+	return Width * Height * HalfBytes[Out] / 2;
+}
+
+static bool Near(int Value, int Expected)
+{
+	//The fixed-point YUV coefficients can round a channel one step away from the exact formula
+	return (Value >= Expected - 1 && Value <= Expected + 1);
+}
+
+static double Pattern(int x, int y, int ch)
+{
+	//Smooth test image between 0.1 and 0.9 (so Lanczos doesn't overshoot the value range) with a different phase per channel
+	return 0.5 + 0.4 * sin(x * 0.11 + ch * 1.7) * cos(y * 0.07 + ch * 0.9);
+}
+
+static double RefWeight(int Mode, double Scale, double Center, int j)
+{
+	//Filter kernels of the resize modes: area coverage when downscaling (bilinear otherwise), bilinear and Lanczos-3, stretched when downscaling
+	const double Pi = 3.14159265358979323846, x = (j + 0.5 - Center) / (Scale > 1.0 ? Scale : 1.0);
+	if (Mode == ResizeCoeffs::FILTER_AREA && Scale > 1.0) return max(0.0, min(j + 1.0, Center + Scale * 0.5) - max((double)j, Center - Scale * 0.5));
+	if (Mode == ResizeCoeffs::FILTER_LANCZOS) return (fabs(x) >= 3.0 ? 0.0 : (x == 0.0 ? 1.0 : 3.0 * sin(Pi * x) * sin(Pi * x / 3.0) / (Pi * Pi * x * x)));
+	return max(0.0, 1.0 - fabs(x));
+}
+
+static void RefResize(const double* Src, int SrcW, int SrcH, int DstW, int DstH, int Mode, double* Dst)
+{
+	//Separable resampling of RGBA pixels, the weights get normalized by what is inside the source at the edges
+	std::vector<double> Tmp((size_t)DstW * SrcH * 4);
+	const double ScaleX = (double)SrcW / DstW, ScaleY = (double)SrcH / DstH;
+	for (int y = 0; y != SrcH; y++)
+		for (int x = 0; x != DstW; x++)
+		{
+			double Sum = 0, Acc[4] = { 0, 0, 0, 0 };
+			for (int j = 0; j != SrcW; j++) { const double w = RefWeight(Mode, ScaleX, (x + 0.5) * ScaleX, j); Sum += w; for (int c = 0; c != 4; c++) Acc[c] += w * Src[(y * SrcW + j) * 4 + c]; }
+			for (int c = 0; c != 4; c++) Tmp[(y * DstW + x) * 4 + c] = Acc[c] / Sum;
+		}
+	for (int y = 0; y != DstH; y++)
+		for (int x = 0; x != DstW; x++)
+		{
+			double Sum = 0, Acc[4] = { 0, 0, 0, 0 };
+			for (int j = 0; j != SrcH; j++) { const double w = RefWeight(Mode, ScaleY, (y + 0.5) * ScaleY, j); Sum += w; for (int c = 0; c != 4; c++) Acc[c] += w * Tmp[(j * DstW + x) * 4 + c]; }
+			for (int c = 0; c != 4; c++) Dst[(y * DstW + x) * 4 + c] = min(1.0, max(0.0, Acc[c] / Sum));
+		}
+}
+
+static void RefYUV(const double* RGB, bool BT2020, bool Deep, int* YUV)
+{
+	//Limited range Y, U and V of a gamma encoded (or HDR signal) RGB color from the luma weights of the matrix
+	const double Kr = (BT2020 ? 0.2627 : 0.2126), Kb = (BT2020 ? 0.0593 : 0.0722), Luma = Kr * RGB[0] + (1.0 - Kr - Kb) * RGB[1] + Kb * RGB[2], Bits = (Deep ? 4.0 : 1.0);
+	YUV[0] = (int)floor(Bits * (16.0 + 219.0 * Luma) + 0.5);
+	YUV[1] = (int)floor(Bits * (128.0 + 224.0 * (RGB[2] - Luma) / (2.0 * (1.0 - Kb))) + 0.5);
+	YUV[2] = (int)floor(Bits * (128.0 + 224.0 * (RGB[0] - Luma) / (2.0 * (1.0 - Kr))) + 0.5);
+}
+
+static void RefBT2020Primaries(double m[3][3])
+{
+	//Linear BT.709 to BT.2020 RGB matrix derived from the chromaticities of both sets of primaries with the D65 white point
+	static const double Prim[2][3][2] = { { { 0.640, 0.330 }, { 0.300, 0.600 }, { 0.150, 0.060 } }, { { 0.708, 0.292 }, { 0.170, 0.797 }, { 0.131, 0.046 } } };
+	const double W[3] = { 0.3127 / 0.3290, 1.0, (1.0 - 0.3127 - 0.3290) / 0.3290 };
+	double ToXYZ[2][3][3], Inv[3][3];
+	for (int p = 0; p != 2; p++)
+	{
+		double P[3][3], I[3][3], S[3];
+		for (int c = 0; c != 3; c++) P[0][c] = Prim[p][c][0] / Prim[p][c][1], P[1][c] = 1.0, P[2][c] = (1.0 - Prim[p][c][0] - Prim[p][c][1]) / Prim[p][c][1];
+		const double Det = P[0][0] * (P[1][1] * P[2][2] - P[1][2] * P[2][1]) - P[0][1] * (P[1][0] * P[2][2] - P[1][2] * P[2][0]) + P[0][2] * (P[1][0] * P[2][1] - P[1][1] * P[2][0]);
+		for (int i = 0; i != 3; i++)
+			for (int j = 0; j != 3; j++)
+				I[j][i] = (P[(i + 1) % 3][(j + 1) % 3] * P[(i + 2) % 3][(j + 2) % 3] - P[(i + 1) % 3][(j + 2) % 3] * P[(i + 2) % 3][(j + 1) % 3]) / Det;
+		for (int i = 0; i != 3; i++) S[i] = I[i][0] * W[0] + I[i][1] * W[1] + I[i][2] * W[2];
+		for (int i = 0; i != 3; i++) for (int j = 0; j != 3; j++) ToXYZ[p][i][j] = P[i][j] * S[j];
+		if (p == 1) for (int i = 0; i != 3; i++) for (int j = 0; j != 3; j++) Inv[i][j] = I[i][j] / S[i];
+	}
+	for (int i = 0; i != 3; i++)
+		for (int j = 0; j != 3; j++)
+			m[i][j] = Inv[i][0] * ToXYZ[0][0][j] + Inv[i][1] * ToXYZ[0][1][j] + Inv[i][2] * ToXYZ[0][2][j];
+}
+
+static double RefTransfer(double L, ProcessJob::ETransfer Transfer)
+{
+	//PQ (SMPTE ST 2084) with 1.0 at 203 nits and HLG (BT.2100) with 1.0 at a signal of 75% as in BT.2408, saturating at 1
+	if (L <= 0.0) return 0.0;
+	if (Transfer == ProcessJob::TRANSFER_PQ)
+	{
+		const double m1 = 2610.0 / 16384.0, m2 = 2523.0 / 4096.0 * 128.0, c1 = 3424.0 / 4096.0, c2 = 2413.0 / 4096.0 * 32.0, c3 = 2392.0 / 4096.0 * 32.0;
+		const double Ym = pow(min(1.0, L * 203.0 / 10000.0), m1);
+		return pow((c1 + c2 * Ym) / (1.0 + c3 * Ym), m2);
+	}
+	const double a = 0.17883277, b = 1.0 - 4.0 * a, c = 0.5 - a * log(4.0 * a);
+	const double E = L * (exp((0.75 - c) / a) + b) / 12.0; //scene light that gives 75%
+	return min(1.0, (E <= 1.0 / 12.0 ? sqrt(3.0 * E) : a * log(12.0 * E - b) + c));
+}
+
+static double RunFrames(const ProcessJob& Job, int Threads, int Frames)
+{
+	//Runs the frames on the worker pool of the filter, the statistics of the last frame end up in those of the job
+	ProcessWorkers Workers(Threads);
+	const double Start = Now();
+	for (int f = 0; f != Frames; f++) Workers.StartNewJob(Job);
+	return (Now() - Start) / Frames;
+}
+
+int main(int argc, char *argv[])
+{
+	const char* NameFilter = NULL;
+	int ResFilterWidth = 0, ResFilterHeight = 0, MaxThreads = (int)std::thread::hardware_concurrency();
+	bool CollectStats = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) MaxThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s")) CollectStats = true;
+		else if (sscanf(argv[i], "%dx%d", &ResFilterWidth, &ResFilterHeight) != 2) NameFilter = argv[i], ResFilterWidth = ResFilterHeight = 0;
+	}
+	if (MaxThreads < 1) MaxThreads = 1;
+
+	const ESIMDLevel BestSIMDLevel = SIMDLevel;
+	printf("Using %s pixel conversion kernels (checked against %s), 1 to %d threads%s\n\n", SIMDLevelNames[BestSIMDLevel], SIMDLevelNames[SIMD_NONE], MaxThreads, (CollectStats ? ", with frame statistics" : ""));
+
+	//The scalar kernels read half floats through the tables which the filter only builds on CPUs without F16C (or for the HDR curves)
+	//The sRGB table here uses the piecewise linear curve of the vectorized kernels instead of the exact one so both give the same results
+	uint8_t* RGBA16Tables[ProcessJob::_TRANSFER_COUNT];
+	uint16_t* RGBA16Tables12[ProcessJob::_TRANSFER_COUNT];
+	for (int t = 0; t != ProcessJob::_TRANSFER_COUNT; t++)
+	{
+		RGBA16Tables[t] = (uint8_t*)malloc(0xFFFF+4), RGBA16Tables12[t] = (uint16_t*)malloc((0xFFFF+2) * sizeof(uint16_t));
+		ProcessJob::BuildRGBA16Table(RGBA16Tables[t], (ProcessJob::ETransfer)t), ProcessJob::BuildRGBA16Table12(RGBA16Tables12[t], (ProcessJob::ETransfer)t);
+	}
+	for (int i = 0; i <= 0xFFFF; i++) RGBA16Tables[ProcessJob::TRANSFER_SRGB][i] = (uint8_t)(i & 0x8000 ? 0 : ProcessJob::FloatToU8<true>(ProcessJob::HalfBitsToFloat(i)));
+
+	//Source rows get padded by up to 79 pixels, so the input buffer gets that much room on top of the largest image the plugin sends
+	const size_t InSize = MAX_SHARED_IMAGE_SIZE + 2160 * 80 * 16, OutSize = 3840 * 2160 * 4;
+	uint8_t* In = (uint8_t*)malloc(InSize);
+	uint8_t* Out = (uint8_t*)malloc(OutSize);
+	uint8_t* Ref = (uint8_t*)malloc(OutSize);
+	for (size_t i = 0; i != InSize / 2; i++) ((uint16_t*)In)[i] = (uint16_t)(i * 2654435761u >> 18); //covers 0.0 to ~2.0 as half floats
+	uint32_t* Background = (uint32_t*)malloc(3840 * 2160 * 4);
+	for (size_t i = 0; i != 3840 * 2160; i++) Background[i] = (uint32_t)(i * 2246822519u);
+
+	int Mismatches = 0;
+	for (const BenchCase& c : Cases)
+	{
+		if (NameFilter && !strstr(c.Name, NameFilter)) continue;
+		for (const int* Res : Resolutions)
+		{
+			if (ResFilterWidth && (Res[0] != ResFilterWidth || Res[1] != ResFilterHeight)) continue;
+			const int OutWidth = Res[0], OutHeight = Res[1];
+			const int InWidth = (c.Rotate ? OutHeight : OutWidth * c.InMul / c.InDiv), InHeight = (c.Rotate ? OutWidth : OutHeight * c.InMul / c.InDiv);
+			if ((size_t)InWidth * InHeight * InputBPP(c.In) > MAX_SHARED_IMAGE_SIZE) continue; //larger than what the plugin can send
+			for (int Padded = 0; Padded != 2; Padded++)
+			{
+				ResizeCoeffs Coeffs;
+				ProcessJob Job;
+				ProcessStats Stats, RefStats;
+				const bool NeedResize = (InWidth != OutWidth || InHeight != OutHeight), Exact = (c.InDiv == 1 && c.InMul >= 2 && c.InMul <= 4);
+				const ProcessJob::ETransfer Transfer = (c.Transfer ? c.Transfer : (c.In == ProcessJob::IN_RGBA16_SRGB ? ProcessJob::TRANSFER_SRGB : ProcessJob::TRANSFER_GAMMA));
+				Job.BufIn = In, Job.BufOut = Out, Job.RGBAInStride = (Padded ? ((InWidth + 63) & ~63) + 16 : InWidth), Job.Coeffs = &Coeffs;
+				Job.RGBA16Table = RGBA16Tables[Transfer], Job.RGBA16Table12 = RGBA16Tables12[Transfer], Job.WideGamut = (c.Transfer != 0);
+				Job.YUV.Set((c.Transfer ? YUVCoeffs::MATRIX_BT2020 : YUVCoeffs::MATRIX_BT709), false, (c.Out >= ProcessJob::OUT_P010)), Job.FlipSource = c.VFlip;
+				Job.Background = (c.Composite ? Background : NULL), Job.BackgroundPitch = OutWidth, Job.AlphaMode = c.AlphaMode, Job.StreamOut = false;
+				Job.Stats = (CollectStats ? &RefStats : NULL), RefStats.Clear();
+				Job.Width = OutWidth, Job.Height = OutHeight, Job.RowStart = 0, Job.RowEnd = OutHeight;
+				if (c.Rotate) Job.Kernel = ProcessJob::GetRotateKernel(c.In, true);
+				else if (!NeedResize) Job.Kernel = ProcessJob::GetConvertKernel(c.In, c.Out, c.Mirror, c.VFlip);
+				else if (Exact && c.ResizeMode == ResizeCoeffs::FILTER_AREA) Job.Kernel = ProcessJob::GetDownscaleKernel(c.In, c.Out, c.Mirror, c.InMul);
+				else { Coeffs.Update(InWidth, InHeight, OutWidth, OutHeight, c.ResizeMode); Job.Kernel = ProcessJob::GetResizeKernel(c.In, c.Out, c.Mirror); }
+
+				//Reference output of the scalar kernels, then a single frame to get an idea of how many frames fill the measuring time
+				const size_t JobOutSize = OutputSize(c.Rotate ? ProcessJob::OUT_BGRA : c.Out, OutWidth, OutHeight);
+				SIMDLevel = SIMD_NONE;
+				Job.BufOut = Ref, Job.Execute();
+				SIMDLevel = BestSIMDLevel;
+				Job.BufOut = Out, Job.Stats = (CollectStats ? &Stats : NULL);
+				if (BestSIMDLevel >= SIMD_AVX2 && !c.Transfer) Job.RGBA16Table = NULL; //let the AVX2 kernels convert half floats directly
+				const int Frames = (int)(0.05 / RunFrames(Job, 1, 1)) + 2;
+
+				double SingleThreaded = 0;
+				const double Bytes = (double)InWidth * InHeight * InputBPP(c.In) + JobOutSize;
+				for (int Threads = 1; Threads <= MaxThreads; Threads++)
+				{
+					memset(Out, 0, JobOutSize);
+					Stats.Clear();
+					const double Seconds = RunFrames(Job, Threads, Frames);
+					const bool Match = (!memcmp(Out, Ref, JobOutSize) && (!CollectStats || (!memcmp(&Stats, &RefStats, sizeof(Stats)) && Stats.Pixels == (uint64_t)OutWidth * OutHeight)));
+					if (Threads == 1) SingleThreaded = Seconds;
+					if (!Match) Mismatches++;
+					printf("%-38s %4dx%-4d -> %4dx%-4d %-10s %2d thread%s %8.3f ms %6.2f GB/s %6.3f ns/pixel %4.0f%%%s\n", c.Name, InWidth, InHeight, OutWidth, OutHeight, (Padded ? "padded" : "contiguous"),
+						Threads, (Threads == 1 ? " " : "s"), Seconds * 1000.0, Bytes / Seconds / 1e9, Seconds * 1e9 / ((double)OutWidth * OutHeight), SingleThreaded / Seconds / Threads * 100.0, (Match ? "" : "  MISMATCH"));
+				}
+			}
+		}
+	}
+	printf("\n%d run%s did not match the scalar reference\n", Mismatches, (Mismatches == 1 ? "" : "s"));
+
+	//Pure colors checked against values computed here from the BT.709 limited range formulas, the runs above only compare the kernels with each other
+	//Both the scalar and the best kernels convert an 8 bit and a half float source (1.0 is 0x3C00) of a single color
+	static const uint8_t Colors[][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0 }, { 0, 255, 255 }, { 255, 0, 255 } }; //RGB
+	static const ProcessJob::EOutput KnownOuts[] = { ProcessJob::OUT_BGR, ProcessJob::OUT_BGRA, ProcessJob::OUT_NV12, ProcessJob::OUT_YUY2, ProcessJob::OUT_I420, ProcessJob::OUT_P010, ProcessJob::OUT_Y210 };
+	static const char* KnownOutNames[] = { "BGR", "BGRA", "NV12", "YUY2", "I420", "P010", "Y210" };
+	const int KnownWidth = 64, KnownHeight = 16, KnownPixels = KnownWidth * KnownHeight;
+	int KnownFailures = 0;
+	printf("\nKnown BT.709 limited range values of pure colors\n");
+	for (const uint8_t* Color : Colors)
+	{
+		const double r = Color[0] / 255.0, g = Color[1] / 255.0, b = Color[2] / 255.0, Luma = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+		const int Y = (int)floor(16.0 + 219.0 * Luma + 0.5), U = (int)floor(128.0 + 224.0 * (b - Luma) / 1.8556 + 0.5), V = (int)floor(128.0 + 224.0 * (r - Luma) / 1.5748 + 0.5);
+		const int Y10 = (int)floor(64.0 + 876.0 * Luma + 0.5), U10 = (int)floor(512.0 + 896.0 * (b - Luma) / 1.8556 + 0.5), V10 = (int)floor(512.0 + 896.0 * (r - Luma) / 1.5748 + 0.5);
+		const uint8_t BGRA[4] = { Color[2], Color[1], Color[0], 255 };
+		for (int Half = 0; Half != 2; Half++)
+		{
+			for (int i = 0; i != KnownPixels; i++)
+				for (int ch = 0; ch != 4; ch++)
+					if (Half) ((uint16_t*)In)[i * 4 + ch] = (uint16_t)(ch == 3 || Color[ch] ? 0x3C00 : 0);
+					else In[i * 4 + ch] = (ch == 3 ? 255 : Color[ch]);
+			for (int o = 0; o != sizeof(KnownOuts) / sizeof(KnownOuts[0]); o++)
+			{
+				for (int Level = 0; Level != 2; Level++)
+				{
+					ProcessJob Job;
+					Job.Kernel = ProcessJob::GetConvertKernel((Half ? ProcessJob::IN_RGBA16_GAMMA : ProcessJob::IN_RGBA8), KnownOuts[o], false, false);
+					Job.BufIn = In, Job.BufOut = Out, Job.RGBAInStride = KnownWidth, Job.Coeffs = NULL, Job.FlipSource = false;
+					Job.RGBA16Table = RGBA16Tables[ProcessJob::TRANSFER_GAMMA], Job.RGBA16Table12 = RGBA16Tables12[ProcessJob::TRANSFER_GAMMA], Job.WideGamut = false, Job.YUV.Set(YUVCoeffs::MATRIX_BT709, false, (KnownOuts[o] >= ProcessJob::OUT_P010));
+					Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+					Job.Width = KnownWidth, Job.Height = KnownHeight, Job.RowStart = 0, Job.RowEnd = KnownHeight;
+					SIMDLevel = (Level ? BestSIMDLevel : SIMD_NONE);
+					memset(Out, 0xCD, OutputSize(KnownOuts[o], KnownWidth, KnownHeight));
+					Job.Execute();
+					SIMDLevel = BestSIMDLevel;
+
+					int Wrong = 0;
+					if (KnownOuts[o] == ProcessJob::OUT_BGR || KnownOuts[o] == ProcessJob::OUT_BGRA)
+					{
+						const int BPP = (KnownOuts[o] == ProcessJob::OUT_BGR ? 3 : 4);
+						for (int i = 0; i != KnownPixels * BPP; i++) Wrong += (Out[i] != BGRA[i % BPP]);
+					}
+					else if (KnownOuts[o] == ProcessJob::OUT_P010 || KnownOuts[o] == ProcessJob::OUT_Y210)
+					{
+						//10 bit values in the high bits of 16 bit samples, P010 has interleaved UV after the luma plane like NV12, Y210 is ordered like YUY2
+						const uint16_t* Out16 = (const uint16_t*)Out;
+						if (KnownOuts[o] == ProcessJob::OUT_Y210) for (int i = 0; i != KnownPixels / 2; i++) Wrong += !Near(Out16[i*4] >> 6, Y10) + !Near(Out16[i*4+1] >> 6, U10) + !Near(Out16[i*4+2] >> 6, Y10) + !Near(Out16[i*4+3] >> 6, V10);
+						else for (int i = 0; i != KnownPixels; i++) Wrong += !Near(Out16[i] >> 6, Y10) + (i < KnownPixels / 4 ? !Near(Out16[KnownPixels + i*2] >> 6, U10) + !Near(Out16[KnownPixels + i*2+1] >> 6, V10) : 0);
+					}
+					else if (KnownOuts[o] == ProcessJob::OUT_YUY2)
+					{
+						for (int i = 0; i != KnownPixels / 2; i++) Wrong += !Near(Out[i*4], Y) + !Near(Out[i*4+1], U) + !Near(Out[i*4+2], Y) + !Near(Out[i*4+3], V);
+					}
+					else
+					{
+						//NV12 has interleaved UV after the luma plane, I420 a U and then a V plane
+						const bool Planar = (KnownOuts[o] == ProcessJob::OUT_I420);
+						for (int i = 0; i != KnownPixels; i++) Wrong += !Near(Out[i], Y);
+						for (int i = 0; i != KnownPixels / 4; i++) Wrong += !Near(Out[KnownPixels + (Planar ? i : i*2)], U) + !Near(Out[KnownPixels + (Planar ? KnownPixels / 4 + i : i*2+1)], V);
+					}
+					if (Wrong) KnownFailures++;
+					printf("RGB %3d,%3d,%3d %-5s to %-4s (Y %3d U %3d V %3d) %-6s %s\n", Color[0], Color[1], Color[2], (Half ? "FP16" : "8 bit"), KnownOutNames[o], (KnownOuts[o] >= ProcessJob::OUT_P010 ? Y10 : Y), (KnownOuts[o] >= ProcessJob::OUT_P010 ? U10 : U), (KnownOuts[o] >= ProcessJob::OUT_P010 ? V10 : V),
+						SIMDLevelNames[Level ? BestSIMDLevel : SIMD_NONE], (Wrong ? "WRONG" : "ok"));
+				}
+			}
+		}
+	}
+	printf("\n%d conversion%s did not give the known values\n", KnownFailures, (KnownFailures == 1 ? "" : "s"));
+	Mismatches += KnownFailures;
+
+	//Resampling, the 10 bit formats, the alpha modes and the HDR curves checked against values computed here in double precision from their
+	//definitions (filter kernels, letterboxing, YUV formulas, alpha math, PQ/HLG curves and the primaries from their chromaticities)
+	//The kernels round in between (8 or 12 bit rows, fixed-point weights and coefficients, half float tables) so a value may be one step off
+	int RefFailures = 0;
+	printf("\nValues computed in double precision\n");
+	static const struct { int InW, InH, OutW, OutH, Mode; } ResizeChecks[] =
+	{
+		{ 150, 90, 100, 60, ResizeCoeffs::FILTER_LINEAR }, { 150, 90, 100, 60, ResizeCoeffs::FILTER_AREA }, { 150, 90, 100, 60, ResizeCoeffs::FILTER_LANCZOS },
+		{ 100, 60, 150, 90, ResizeCoeffs::FILTER_LINEAR }, { 100, 60, 150, 90, ResizeCoeffs::FILTER_LANCZOS }, { 100, 60, 150, 90, ResizeCoeffs::FILTER_AREA },
+		{ 200, 120, 100, 60, ResizeCoeffs::FILTER_AREA }, { 300, 180, 100, 60, ResizeCoeffs::FILTER_AREA }, { 400, 240, 100, 60, ResizeCoeffs::FILTER_AREA },
+		{ 160, 90, 100, 76, ResizeCoeffs::FILTER_LINEAR }, { 90, 160, 100, 60, ResizeCoeffs::FILTER_AREA }, { 61, 37, 100, 60, ResizeCoeffs::FILTER_LANCZOS },
+	};
+	static const char* ResizeModeNames[] = { "", "linear", "area", "lanczos" };
+	for (const auto& rc : ResizeChecks)
+	{
+		//An 8 bit source scaled to BGRA and a half float (gamma) source scaled to P010, checked in the image area and black in the borders
+		const double Scale = max((double)rc.InW / rc.OutW, (double)rc.InH / rc.OutH);
+		const int ImgW = min(rc.OutW, max(1, (int)(rc.InW / Scale + 0.5))), ImgH = min(rc.OutH, max(1, (int)(rc.InH / Scale + 0.5))), ImgX = (rc.OutW - ImgW) / 2, ImgY = (rc.OutH - ImgH) / 2;
+		const bool Box = (rc.Mode == ResizeCoeffs::FILTER_AREA && rc.InW == rc.OutW * (rc.InW / rc.OutW) && rc.InH == rc.OutH * (rc.InW / rc.OutW) && rc.InW / rc.OutW >= 2 && rc.InW / rc.OutW <= 4);
+		std::vector<double> Src((size_t)rc.InW * rc.InH * 4), Ref((size_t)ImgW * ImgH * 4);
+		for (int Deep = 0; Deep != 2; Deep++)
+		{
+			for (int y = 0; y != rc.InH; y++)
+				for (int x = 0; x != rc.InW; x++)
+					for (int ch = 0; ch != 4; ch++)
+					{
+						const size_t i = ((size_t)y * rc.InW + x) * 4 + ch;
+						if (Deep) ((uint16_t*)In)[i] = ProcessJob::LinearToHalfBits((float)Pattern(x, y, ch)), Src[i] = ProcessJob::HalfBitsToLinear(((uint16_t*)In)[i]);
+						else In[i] = (uint8_t)floor(Pattern(x, y, ch) * 255.0 + 0.5), Src[i] = In[i] / 255.0;
+					}
+			RefResize(&Src[0], rc.InW, rc.InH, ImgW, ImgH, rc.Mode, &Ref[0]);
+			for (int Level = 0; Level != 2; Level++)
+			{
+				ResizeCoeffs Coeffs;
+				ProcessJob Job;
+				const ProcessJob::EInput JobIn = (Deep ? ProcessJob::IN_RGBA16_GAMMA : ProcessJob::IN_RGBA8);
+				const ProcessJob::EOutput JobOut = (Deep ? ProcessJob::OUT_P010 : ProcessJob::OUT_BGRA);
+				if (Box) Job.Kernel = ProcessJob::GetDownscaleKernel(JobIn, JobOut, false, rc.InW / rc.OutW);
+				else Coeffs.Update(rc.InW, rc.InH, rc.OutW, rc.OutH, rc.Mode), Job.Kernel = ProcessJob::GetResizeKernel(JobIn, JobOut, false);
+				Job.BufIn = In, Job.BufOut = Out, Job.RGBAInStride = rc.InW, Job.Coeffs = &Coeffs, Job.FlipSource = false;
+				Job.RGBA16Table = RGBA16Tables[ProcessJob::TRANSFER_GAMMA], Job.RGBA16Table12 = RGBA16Tables12[ProcessJob::TRANSFER_GAMMA], Job.WideGamut = false, Job.YUV.Set(YUVCoeffs::MATRIX_BT709, false, (Deep != 0));
+				Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+				Job.Width = rc.OutW, Job.Height = rc.OutH, Job.RowStart = 0, Job.RowEnd = rc.OutH;
+				SIMDLevel = (Level ? BestSIMDLevel : SIMD_NONE);
+				memset(Out, 0xCD, OutputSize(JobOut, rc.OutW, rc.OutH));
+				Job.Execute();
+				SIMDLevel = BestSIMDLevel;
+
+				//The source is bottom-up like the textures of Unity and so is BGRA, YUV is top-down so its first row is the last row of the scaled image
+				int Wrong = 0, MaxDiff = 0;
+				const uint16_t* Out16 = (const uint16_t*)Out;
+				for (int y = 0; y != rc.OutH; y++)
+					for (int x = 0; x != rc.OutW; x++)
+					{
+						const int r = (Deep ? rc.OutH - 1 - y : y) - ImgY, c = x - ImgX;
+						const bool Inside = (r >= 0 && r < ImgH && c >= 0 && c < ImgW);
+						const double* px = (Inside ? &Ref[((size_t)r * ImgW + c) * 4] : NULL);
+						if (!Deep)
+						{
+							for (int ch = 0; ch != 4; ch++)
+							{
+								const int Value = Out[((size_t)y * rc.OutW + x) * 4 + ch], Expected = (Inside ? (int)floor(px[ch == 3 ? 3 : 2 - ch] * 255.0 + 0.5) : 0);
+								MaxDiff = max(MaxDiff, abs(Value - Expected)), Wrong += !Near(Value, Expected);
+							}
+							continue;
+						}
+						int YUV[3] = { 64, 512, 512 };
+						if (Inside) RefYUV(px, false, true, YUV);
+						const int Value = Out16[(size_t)y * rc.OutW + x] >> 6;
+						MaxDiff = max(MaxDiff, abs(Value - YUV[0])), Wrong += !Near(Value, YUV[0]);
+						if ((x & 1) || (y & 1) || !Inside) continue;
+
+						//Chroma of 2x2 blocks that are completely inside the image area is the average of the chroma of the 4 pixels
+						const int r1 = r - 1, c1 = c + 1;
+						if (r1 < 0 || c1 >= ImgW) continue;
+						double Avg[3] = { 0, 0, 0 };
+						for (int k = 0; k != 4; k++) for (int ch = 0; ch != 3; ch++) Avg[ch] += Ref[((size_t)(k & 2 ? r1 : r) * ImgW + (k & 1 ? c1 : c)) * 4 + ch] * 0.25;
+						RefYUV(Avg, false, true, YUV);
+						const uint16_t* uv = Out16 + (size_t)rc.OutW * rc.OutH + (size_t)(y / 2) * rc.OutW + x;
+						MaxDiff = max(MaxDiff, max(abs((uv[0] >> 6) - YUV[1]), abs((uv[1] >> 6) - YUV[2]))), Wrong += !Near(uv[0] >> 6, YUV[1]) + !Near(uv[1] >> 6, YUV[2]);
+					}
+				if (Wrong) RefFailures++;
+				printf("Resize %3dx%-3d -> %3dx%-3d %-7s %-5s to %-4s %-6s max diff %d %s\n", rc.InW, rc.InH, rc.OutW, rc.OutH, ResizeModeNames[rc.Mode], (Deep ? "FP16" : "8 bit"), (Deep ? "P010" : "BGRA"),
+					SIMDLevelNames[Level ? BestSIMDLevel : SIMD_NONE], MaxDiff, (Wrong ? "WRONG" : "ok"));
+			}
+		}
+	}
+
+	//Premultiplying and unpremultiplying every combination of some color and alpha values (premultiplied colors above alpha get clamped to it)
+	static const uint8_t AlphaCheckValues[] = { 0, 1, 2, 37, 64, 127, 128, 200, 254, 255 };
+	const int AlphaCheckCount = sizeof(AlphaCheckValues);
+	for (int m = ProcessJob::ALPHA_PREMULTIPLY; m <= ProcessJob::ALPHA_UNPREMULTIPLY; m++)
+	{
+		for (int i = 0; i != AlphaCheckCount * AlphaCheckCount; i++)
+			In[i * 4 + 0] = In[i * 4 + 1] = In[i * 4 + 2] = AlphaCheckValues[i % AlphaCheckCount], In[i * 4 + 3] = AlphaCheckValues[i / AlphaCheckCount];
+		for (int Level = 0; Level != 2; Level++)
+		{
+			ProcessJob Job;
+			Job.Kernel = ProcessJob::GetConvertKernel(ProcessJob::IN_RGBA8, ProcessJob::OUT_BGRA, false, false);
+			Job.BufIn = In, Job.BufOut = Out, Job.RGBAInStride = AlphaCheckCount, Job.Coeffs = NULL, Job.FlipSource = false;
+			Job.RGBA16Table = NULL, Job.RGBA16Table12 = NULL, Job.WideGamut = false, Job.YUV.Set(YUVCoeffs::MATRIX_BT709, false);
+			Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = (ProcessJob::EAlpha)m, Job.StreamOut = false, Job.Stats = NULL;
+			Job.Width = AlphaCheckCount, Job.Height = AlphaCheckCount, Job.RowStart = 0, Job.RowEnd = AlphaCheckCount;
+			SIMDLevel = (Level ? BestSIMDLevel : SIMD_NONE);
+			Job.Execute();
+			SIMDLevel = BestSIMDLevel;
+			int Wrong = 0, MaxDiff = 0;
+			for (int i = 0; i != AlphaCheckCount * AlphaCheckCount; i++)
+			{
+				const int c = AlphaCheckValues[i % AlphaCheckCount], a = AlphaCheckValues[i / AlphaCheckCount];
+				const int Expected = (m == ProcessJob::ALPHA_PREMULTIPLY ? (int)floor(c * a / 255.0 + 0.5) : (a ? (int)floor(min(c, a) * 255.0 / a + 0.5) : 0));
+				for (int ch = 0; ch != 3; ch++) MaxDiff = max(MaxDiff, abs(Out[i * 4 + ch] - Expected)), Wrong += !Near(Out[i * 4 + ch], Expected);
+				Wrong += (Out[i * 4 + 3] != a);
+			}
+			if (Wrong) RefFailures++;
+			printf("%-13s 8 bit to BGRA %-6s max diff %d %s\n", (m == ProcessJob::ALPHA_PREMULTIPLY ? "Premultiply" : "Unpremultiply"), SIMDLevelNames[Level ? BestSIMDLevel : SIMD_NONE], MaxDiff, (Wrong ? "WRONG" : "ok"));
+		}
+	}
+
+	//Linear half float colors (1.0 is SDR white) encoded for BT.2100 with the BT.2020 primaries, curve and matrix into P010 and Y210
+	static const float HDRColors[][3] = { { 0, 0, 0 }, { 1, 1, 1 }, { 0.18f, 0.18f, 0.18f }, { 4, 4, 4 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0.5f, 0.25f, 0.125f }, { 2, 1.5f, 0.01f } };
+	double Primaries[3][3];
+	RefBT2020Primaries(Primaries);
+	for (int t = ProcessJob::TRANSFER_PQ; t <= ProcessJob::TRANSFER_HLG; t++)
+	{
+		for (const float* Color : HDRColors)
+		{
+			double Signal[3];
+			for (int ch = 0; ch != 3; ch++) Signal[ch] = RefTransfer(Primaries[ch][0] * Color[0] + Primaries[ch][1] * Color[1] + Primaries[ch][2] * Color[2], (ProcessJob::ETransfer)t);
+			int YUV[3];
+			RefYUV(Signal, true, true, YUV);
+			for (int i = 0; i != KnownPixels; i++)
+				for (int ch = 0; ch != 4; ch++) ((uint16_t*)In)[i * 4 + ch] = ProcessJob::LinearToHalfBits(ch == 3 ? 1.0f : Color[ch]);
+			for (int o = ProcessJob::OUT_P010; o <= ProcessJob::OUT_Y210; o++)
+			{
+				for (int Level = 0; Level != 2; Level++)
+				{
+					ProcessJob Job;
+					Job.Kernel = ProcessJob::GetConvertKernel(ProcessJob::IN_RGBA16_SRGB, (ProcessJob::EOutput)o, false, false);
+					Job.BufIn = In, Job.BufOut = Out, Job.RGBAInStride = KnownWidth, Job.Coeffs = NULL, Job.FlipSource = false;
+					Job.RGBA16Table = RGBA16Tables[t], Job.RGBA16Table12 = RGBA16Tables12[t], Job.WideGamut = true, Job.YUV.Set(YUVCoeffs::MATRIX_BT2020, false, true);
+					Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+					Job.Width = KnownWidth, Job.Height = KnownHeight, Job.RowStart = 0, Job.RowEnd = KnownHeight;
+					SIMDLevel = (Level ? BestSIMDLevel : SIMD_NONE);
+					memset(Out, 0xCD, OutputSize((ProcessJob::EOutput)o, KnownWidth, KnownHeight));
+					Job.Execute();
+					SIMDLevel = BestSIMDLevel;
+					const uint16_t* Out16 = (const uint16_t*)Out;
+					int Wrong = 0;
+					if (o == ProcessJob::OUT_Y210) for (int i = 0; i != KnownPixels / 2; i++) Wrong += !Near(Out16[i*4] >> 6, YUV[0]) + !Near(Out16[i*4+1] >> 6, YUV[1]) + !Near(Out16[i*4+2] >> 6, YUV[0]) + !Near(Out16[i*4+3] >> 6, YUV[2]);
+					else for (int i = 0; i != KnownPixels; i++) Wrong += !Near(Out16[i] >> 6, YUV[0]) + (i < KnownPixels / 4 ? !Near(Out16[KnownPixels + i*2] >> 6, YUV[1]) + !Near(Out16[KnownPixels + i*2+1] >> 6, YUV[2]) : 0);
+					if (Wrong) RefFailures++;
+					printf("RGB %5.2f,%5.2f,%5.2f linear to %s %s (Y %4d U %4d V %4d) %-6s %s\n", Color[0], Color[1], Color[2], (o == ProcessJob::OUT_P010 ? "P010" : "Y210"), (t == ProcessJob::TRANSFER_PQ ? "PQ " : "HLG"),
+						YUV[0], YUV[1], YUV[2], SIMDLevelNames[Level ? BestSIMDLevel : SIMD_NONE], (Wrong ? "WRONG" : "ok"));
+				}
+			}
+		}
+	}
+	printf("\n%d check%s did not give the values computed in double precision\n", RefFailures, (RefFailures == 1 ? "" : "s"));
+	Mismatches += RefFailures;
+
+	//Compare regular and non-temporal stores for increasing frame sizes, the filter switches to streaming above the last level cache size
+	//Writing to a different output buffer each run like the capture filter does (it gets a new sample buffer for every frame)
+	static const int Sizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+	uint8_t* Outs[3] = { Out, (uint8_t*)malloc(OutSize), (uint8_t*)malloc(OutSize) };
+	printf("\nNon-temporal stores (last level cache size %d KB)\n", (int)(GetLastLevelCacheSize() / 1024));
+	int Crossover = -1;
+	for (int s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+	{
+		double Millis[2];
+		for (int Stream = 0; Stream != 2; Stream++)
+		{
+			ProcessJob Job;
+			Job.Kernel = ProcessJob::GetConvertKernel(ProcessJob::IN_RGBA8, ProcessJob::OUT_BGRA, false, false);
+			Job.BufIn = In, Job.RGBAInStride = Sizes[s][0], Job.RGBA16Table = NULL, Job.RGBA16Table12 = NULL, Job.WideGamut = false, Job.Coeffs = NULL, Job.FlipSource = false;
+			Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = (Stream != 0), Job.Stats = NULL;
+			Job.Width = Sizes[s][0], Job.Height = Sizes[s][1], Job.RowStart = 0, Job.RowEnd = Sizes[s][1];
+			int Runs = 0;
+			const double Start = Now();
+			double End;
+			do { Job.BufOut = Outs[Runs % 3]; Job.Execute(); Runs++; End = Now(); } while (End - Start < 0.5);
+			Millis[Stream] = (End - Start) * 1000.0 / Runs;
+		}
+		const bool Faster = (Millis[1] < Millis[0]);
+		if (!Faster) Crossover = -1;
+		else if (Crossover < 0) Crossover = s;
+		printf("Convert RGBA8 to BGRA %4dx%-4d (%6d KB)  regular %7.3f ms  streaming %7.3f ms%s\n", Sizes[s][0], Sizes[s][1], Sizes[s][0] * Sizes[s][1] * 4 / 1024, Millis[0], Millis[1], (Faster ? "  (streaming faster)" : ""));
+	}
+	if (Crossover >= 0) printf("Crossover: streaming is faster from %dx%d on\n", Sizes[Crossover][0], Sizes[Crossover][1]);
+	else printf("Crossover: streaming is not faster up to the largest frame size on this machine\n");
+	free(Outs[2]);
+	free(Outs[1]);
+
+	//Hashing of the source tiles for the filter option that only converts changed tiles, this reads the whole source once per frame
+	//Changing a single byte has to change the hash of its tile and of no other tile
+	printf("\nSource tile hashes (%d rows per tile)\n", (int)ProcessJob::TILE_ROWS);
+	uint64_t* Hashes = (uint64_t*)malloc((2160 / ProcessJob::TILE_ROWS + 1) * 2 * sizeof(uint64_t));
+	for (int s = 0; s != sizeof(Sizes) / sizeof(Sizes[0]); s++)
+	{
+		for (int BPP = 4; BPP <= 8; BPP *= 2)
+		{
+			const size_t Tiles = (Sizes[s][1] + ProcessJob::TILE_ROWS - 1) / ProcessJob::TILE_ROWS;
+			ProcessJob Job;
+			Job.Kernel = &ProcessJob::HashTiles;
+			Job.BufIn = In, Job.BufOut = Hashes, Job.RGBAInStride = Sizes[s][0] * BPP, Job.RGBA16Table = NULL, Job.RGBA16Table12 = NULL, Job.WideGamut = false, Job.Coeffs = NULL, Job.FlipSource = false;
+			Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+			Job.Width = Sizes[s][0] * BPP, Job.Height = Sizes[s][1], Job.RowStart = 0, Job.RowEnd = Tiles;
+			int Runs = 0;
+			const double Start = Now();
+			double End;
+			do { Job.Execute(); Runs++; End = Now(); } while (End - Start < 0.25);
+			uint8_t* Changed = In + (Sizes[s][1] / 2) * Job.RGBAInStride + Job.Width / 3;
+			Job.BufOut = Hashes + Tiles, *Changed ^= 1, Job.Execute(), *Changed ^= 1;
+			int Differing = 0;
+			for (size_t t = 0; t != Tiles; t++) Differing += (Hashes[t] != Hashes[Tiles + t]);
+			if (Differing != 1) Mismatches++;
+			printf("Hash %s source %4dx%-4d %8.3f ms %6.2f GB/s%s\n", (BPP == 4 ? "8 bit" : "FP16 "), Sizes[s][0], Sizes[s][1], (End - Start) * 1000.0 / Runs,
+				(double)Job.Width * Job.Height * Runs / (End - Start) / 1e9, (Differing == 1 ? "" : "  MISMATCH"));
+		}
+	}
+	free(Hashes);
+
+	free(Background);
+	free(Ref);
+	free(Out);
+	free(In);
+	for (int t = 0; t != ProcessJob::_TRANSFER_COUNT; t++) free(RGBA16Tables12[t]), free(RGBA16Tables[t]);
+	return (Mismatches ? 1 : 0);
+}
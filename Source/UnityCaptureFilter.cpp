@@ -31,7 +31,8 @@
 #include "streams.h"
 #include <cguid.h>
 #include <strsafe.h>
-#include <math.h>
+#include <dvdmedia.h>
+#include "process.inl"
 
 #define CaptureSourceName L"Unity Video Capture"
 
@@ -73,6 +74,23 @@ static struct { int width, height; } _media[] =
 	{    0,    0 }, //This slot is used for custom resolutions if requested by the target application
 };
 
+//List of pixel formats offered for each resolution, the YUV formats are what most video applications and encoders work with natively
+//P010 and Y210 are 10 bit formats that keep more of the precision of HDR (16 bit float) render textures
+//I420, P010 and Y210 are not in all DirectShow headers (uuids.h), they use the standard mapping of a FOURCC code to a subtype GUID
+DEFINE_GUID(MEDIASUBTYPE_I420_FOURCC, 0x30323449, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(MEDIASUBTYPE_P010_FOURCC, 0x30313050, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+DEFINE_GUID(MEDIASUBTYPE_Y210_FOURCC, 0x30313259, 0x0000, 0x0010, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71);
+static const struct { const GUID* subtype; DWORD compression; WORD bits; ProcessJob::EOutput output; } _formats[] =
+{
+	{ &MEDIASUBTYPE_RGB24,        BI_RGB,                      24, ProcessJob::OUT_BGR  },
+	{ &MEDIASUBTYPE_ARGB32,       BI_RGB,                      32, ProcessJob::OUT_BGRA },
+	{ &MEDIASUBTYPE_NV12,         MAKEFOURCC('N','V','1','2'), 12, ProcessJob::OUT_NV12 },
+	{ &MEDIASUBTYPE_YUY2,         MAKEFOURCC('Y','U','Y','2'), 16, ProcessJob::OUT_YUY2 },
+	{ &MEDIASUBTYPE_I420_FOURCC,  MAKEFOURCC('I','4','2','0'), 12, ProcessJob::OUT_I420 },
+	{ &MEDIASUBTYPE_P010_FOURCC,  MAKEFOURCC('P','0','1','0'), 24, ProcessJob::OUT_P010 },
+	{ &MEDIASUBTYPE_Y210_FOURCC,  MAKEFOURCC('Y','2','1','0'), 32, ProcessJob::OUT_Y210 },
+};
+
 //Error draw modes (what to display on screen in case of errors/warnings)
 enum EErrorDrawCase { EDC_ResolutionMismatch, EDC_UnityNeverStarted, EDC_UnitySendingStopped, _EDC_MAX };
 enum EErrorDrawMode { EDM_GREENKEY, EDM_BLUEPINK, EDM_GREENYELLOW, EDM_BLACK };
@@ -80,6 +98,35 @@ static EErrorDrawMode ErrorDrawModes[_EDC_MAX] = { EDM_BLUEPINK, EDM_GREENYELLOW
 static wchar_t* ErrorDrawModeNames[] = { L"Green Key (RGB #00FE00)", L"Blue/Pink Pattern", L"Green/Yellow Pattern", L"Fill Black" };
 static bool OutputFrameRate = false;
 
+//Only convert the parts of the image that changed since the last frame, detected by hashing tiles of source rows (helps with mostly static scenes)
+static bool DirtyTiles = false;
+
+//Number of threads converting the frames of each capture device (0 for automatic which uses one per logical processor)
+static int WorkerThreadCounts[SharedImageMemory::MAX_CAPNUM + 1];
+
+//Receive and convert the next frame on a separate thread while the last one is being delivered (see DoBufferProcessingLoop)
+static bool PipelinedDelivery = false;
+
+//YUV color space (matrix and value range) used for the YUV output formats, the automatic mode picks by resolution like most decoders assume
+enum EYUVColorSpace { YCS_AUTO, YCS_BT601, YCS_BT709, YCS_BT601_FULL, YCS_BT709_FULL, YCS_BT2100_PQ, YCS_BT2100_HLG };
+static EYUVColorSpace YUVColorSpace = YCS_AUTO;
+static wchar_t* YUVColorSpaceNames[] = { L"Automatic (BT.601 for SD, BT.709 for HD)", L"BT.601 Limited Range", L"BT.709 Limited Range", L"BT.601 Full Range", L"BT.709 Full Range", L"BT.2100 PQ (HDR, 10-bit formats)", L"BT.2100 HLG (HDR, 10-bit formats)" };
+
+//In the HDR modes the 10 bit formats get offered with VIDEOINFOHEADER2 which carries the color information in dwControlFlags
+//That is the DXVA_ExtendedFormat bit layout without the sample format, DXVA has no values for BT.2020 and the HDR curves so these
+//are the ones Media Foundation extended it with (MFVideoTransferMatrix_BT2020_10, MFVideoPrimaries_BT2020, MFVideoTransFunc_2084/_HLG)
+static DWORD GetHDRControlFlags(EYUVColorSpace ycs)
+{
+	enum { NOMINALRANGE_16_235 = 2, TRANSFERMATRIX_BT2020 = 4, PRIMARIES_BT2020 = 9, TRANSFUNC_PQ = 15, TRANSFUNC_HLG = 16 };
+	return AMCONTROL_USED | AMCONTROL_COLORINFO_PRESENT | (NOMINALRANGE_16_235 << 12) | (TRANSFERMATRIX_BT2020 << 15) | (PRIMARIES_BT2020 << 22) | ((DWORD)(ycs == YCS_BT2100_PQ ? TRANSFUNC_PQ : TRANSFUNC_HLG) << 27);
+}
+
+//Background the image gets blended over for the RGB output format which has no alpha channel (by default the alpha channel is just dropped)
+//The image mode uses the file UnityCaptureBackground.bmp in the directory of the filter DLL, falling back to black if it can't be loaded
+enum EBackgroundMode { BGM_NONE, BGM_BLACK, BGM_WHITE, BGM_GREENKEY, BGM_IMAGE };
+static EBackgroundMode BackgroundMode = BGM_NONE;
+static wchar_t* BackgroundModeNames[] = { L"None (ignore alpha)", L"Black", L"White", L"Green Key (RGB #00FE00)", L"Image (UnityCaptureBackground.bmp)" };
+
 #ifdef _DEBUG
 void DebugLog(const char *format, ...)
 {
@@ -95,7 +142,7 @@ void DebugLog(const char *format, ...)
 
 //Interface definition for ICamSource used by CCaptureSource
 DEFINE_GUID(IID_ICamSource, 0xdd20e647, 0xf3e5, 0x4156, 0xb3, 0x7b, 0x54, 0x6f, 0xcf, 0x88, 0xec, 0x50);
-DECLARE_INTERFACE_(ICamSource, IUnknown) { };
+DECLARE_INTERFACE_(ICamSource, IUnknown) { STDMETHOD_(int, GetCapNum)() PURE; };
 
 class CCaptureStream : CSourceStream, IKsPropertySet, IAMStreamConfig, IAMStreamControl, IAMPushSource
 {
@@ -106,17 +153,20 @@ public:
 		m_prevStartTime = 0;
 		m_avgTimePerFrame = 10000000 / 30;
 		m_pReceiver = new SharedImageMemory(CapNum);
-		m_iUnscaledBufSize = 0;
-		m_pUnscaledBuf = NULL;
-		m_RGBA16Table = NULL;
+		m_pScratchBuf = NULL;
+		m_ScratchBufSize = 0;
+		m_pBackground = m_pBackgroundImage = NULL;
+		m_BackgroundImageLoaded = false;
 		GetMediaType(0, &m_mt);
+		DebugLog("[CCaptureStream] Using %s pixel conversion kernels\n", SIMDLevelNames[SIMDLevel]);
 	}
 
 	virtual ~CCaptureStream()
 	{
 		delete m_pReceiver;
-		if (m_pUnscaledBuf) free(m_pUnscaledBuf);
-		if (m_RGBA16Table) free(m_RGBA16Table);
+		if (m_pScratchBuf) free(m_pScratchBuf);
+		if (m_pBackground) free(m_pBackground);
+		if (m_pBackgroundImage) free(m_pBackgroundImage);
 	}
 
 private:
@@ -124,20 +174,29 @@ private:
 	{
 		HRESULT hr;
 		BYTE* pBuf;
-		VIDEOINFO *pvi = (VIDEOINFO*)m_mt.Format();
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(&m_mt);
 		REFERENCE_TIME startTime = m_prevStartTime, endTime = startTime + m_avgTimePerFrame;
 		LONGLONG mtStart = m_llFrame, mtEnd = mtStart + 1;
 		m_prevStartTime = endTime;
 		m_llFrame = mtEnd;
-		UCASSERT(pSamp->GetSize() == pvi->bmiHeader.biSizeImage);
-		UCASSERT(DIBSIZE(pvi->bmiHeader) == pvi->bmiHeader.biSizeImage);
+		UCASSERT(pSamp->GetSize() == pbmi->biSizeImage);
+		UCASSERT(GetImageSize(*pbmi) == pbmi->biSizeImage);
 
 		if (FAILED(hr = pSamp->GetPointer(&pBuf))) return hr;
-		if (FAILED(hr = pSamp->SetActualDataLength(pvi->bmiHeader.biSizeImage))) return hr;
+		if (FAILED(hr = pSamp->SetActualDataLength(pbmi->biSizeImage))) return hr;
 		if (FAILED(hr = pSamp->SetTime(&startTime, &endTime))) return hr;
 		if (FAILED(hr = pSamp->SetMediaTime(&mtStart, &mtEnd))) return hr;
 
-		ProcessState State = { pBuf, pvi->bmiHeader.biWidth, pvi->bmiHeader.biHeight, pvi->bmiHeader.biBitCount / 8, this };
+		ProcessState State = { pBuf, pbmi->biWidth, pbmi->biHeight, pbmi->biBitCount / 8, GetOutputFormat(*pbmi), this };
+		if (State.Output >= ProcessJob::OUT_NV12)
+		{
+			//The HDR modes are only applied to linear 16 bit float sources with 10 bit output (see ProcessImage), everything else gets BT.709
+			const EYUVColorSpace ycs = State.YUVColorSpace = YUVColorSpace; //read once as it can be changed from the property page at any time
+			const bool HD = (State.BufHeight >= 720), BT709 = (ycs == YCS_AUTO ? HD : (ycs != YCS_BT601 && ycs != YCS_BT601_FULL));
+			State.YUV.Set((BT709 ? YUVCoeffs::MATRIX_BT709 : YUVCoeffs::MATRIX_BT601), (ycs == YCS_BT601_FULL || ycs == YCS_BT709_FULL), (State.Output >= ProcessJob::OUT_P010));
+		}
+		m_ProcessWorkers.SetThreadCount(WorkerThreadCounts[m_pReceiver->GetCapNum()]); //can be changed from the property page at any time
+		m_ProcessWorkers.SetFrameTime((uint32_t)(m_avgTimePerFrame / 10)); //the pool threads shared with other streams help the one closest to its deadline first
 		switch (m_pReceiver->Receive((SharedImageMemory::ReceiveCallbackFunc)ProcessImage, &State))
 		{
 			case SharedImageMemory::RECEIVERES_CAPTUREINACTIVE:{
@@ -159,306 +218,152 @@ private:
 				int DisplayStringLens[] = { sizeof(DisplayString) - 1 };
 				FillErrorPattern(ErrorDrawModes[EDC_UnitySendingStopped], &State, 1, DisplayStrings, DisplayStringLens, m_llFrame);
 				break;}
+
+			case SharedImageMemory::RECEIVERES_VERSIONMISMATCH:{
+				//Show color pattern indicating that the Unity plugin DLL is from a different release than this filter DLL
+				char DisplayString[] = "Unity capture plugin version does not match the capture device", *DisplayStrings[] = { DisplayString };
+				int DisplayStringLens[] = { sizeof(DisplayString) - 1 };
+				FillErrorPattern(ErrorDrawModes[EDC_UnityNeverStarted], &State, 1, DisplayStrings, DisplayStringLens, m_llFrame);
+				Sleep((DWORD)(m_avgTimePerFrame / 10000 - 1)); //just wait a bit until capturing next frame
+				break;}
 		}
 		if (OutputFrameRate) RenderFPSDisplay(&State);
 		return S_OK;
 	}
 
-	struct ProcessJob
+	struct DirtyTileState
 	{
-		enum EType { JOB_NONE, JOB_RGBA8toBGR8, JOB_RGBA8toBGRA8, JOB_RGBA16toBGR8, JOB_RGBA16toBGRA8, JOB_BGR_RESIZE_LINEAR, JOB_BGRA_RESIZE_LINEAR, JOB_BGR_MIRROR_HORIZONTAL, JOB_BGRA_MIRROR_HORIZONTAL } Type;
-		const void *BufIn; void *BufOut;
-		size_t Width, RowStart, RowEnd, RGBAInStride, ResizeToHeight, ResizeFromWidth, ResizeFromHeight;
-		const uint8_t* RGBA16Table;
-
-		inline void Execute()
-		{
-			UCASSERT(RowEnd >= RowStart);
-			if (RowStart == RowEnd) return;
-			if      (Type == JOB_RGBA8toBGR8)            RGBA8toBGR8();
-			else if (Type == JOB_RGBA8toBGRA8)           RGBA8toBGRA8();
-			else if (Type == JOB_RGBA16toBGR8)           RGBA16toBGR8();
-			else if (Type == JOB_RGBA16toBGRA8)          RGBA16toBGRA8();
-			else if (Type == JOB_BGR_RESIZE_LINEAR)      BGRResizeLinear();
-			else if (Type == JOB_BGRA_RESIZE_LINEAR)     BGRAResizeLinear();
-			else if (Type == JOB_BGR_MIRROR_HORIZONTAL)  BGRMirrorHorizontal();
-			else if (Type == JOB_BGRA_MIRROR_HORIZONTAL) BGRAMirrorHorizontal();
-		}
+		//Source tile hashes and the persistent output frame of the dirty tile mode (see ConvertChangedTiles)
+		//The key holds everything besides the source pixels that the converted frame depends on, any change of it converts the whole frame again
+		struct Key { ProcessJob::KernelFunc Kernel; const void *Table, *Table12; const uint32_t* Background; EBackgroundMode BackgroundMode; size_t BackgroundPitch, Width, Height, Size; int InWidth, InHeight, InStride, InBPP, ResizeMode, AlphaMode; bool FlipSource; YUVCoeffs YUV; };
+		Key LastKey;
+		uint64_t* Hashes; //hashes of the tiles of the last converted frame followed by the ones of the current frame
+		uint32_t* Tiles; //list of the output tiles that need converting
+		uint8_t* Frame;
+		bool Valid;
+		uint32_t LastTiles, LastDirty; //number of output tiles of the last frame and how many of them changed (0 if the mode is not used)
+
+		DirtyTileState() : Hashes(NULL), Tiles(NULL), Frame(NULL) { Release(); }
+		~DirtyTileState() { Release(); }
+		void Release() { free(Hashes); free(Tiles); free(Frame); Hashes = NULL, Tiles = NULL, Frame = NULL; memset(&LastKey, 0, sizeof(LastKey)); Valid = false, LastTiles = LastDirty = 0; }
+	};
 
-		void RGBA8toBGR8()
+	struct LastFrameState
+	{
+		//Copy of the last converted frame which gets output again for repeated frames instead of converting the same data again
+		//Copies only get made for a while after a frame got repeated, as long as Unity keeps up no time is spent on them
+		//The key holds the capture device settings that change the output, the ones of the sender only change together with the sequence
+		enum { KEEP_FRAMES = 120 }; //number of new frames that still get kept after the last repeated frame
+		struct Key { uint32_t Sequence; ProcessJob::EOutput Output; int Width, Height; EYUVColorSpace YUVColorSpace; EBackgroundMode BackgroundMode; };
+		Key LastKey;
+		uint8_t* Frame; size_t FrameSize;
+		int KeepCount;
+
+		LastFrameState() : Frame(NULL), FrameSize(0), KeepCount(0) { memset(&LastKey, 0, sizeof(LastKey)); }
+		~LastFrameState() { free(Frame); }
+
+		void Store(const uint8_t* Buf, size_t Size)
 		{
-			const uint32_t *src = (const uint32_t*)BufIn + (RowStart * RGBAInStride);
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			if (RGBAInStride != Width)
+			if (KeepCount > 0)
 			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint32_t *srcLastRow = (const uint32_t*)BufIn + ((RowEnd - 1) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcLastRow; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst += 3)
-						*(uint32_t*)dst = _byteswap_ulong(src[i]) >> 8;
-				for (size_t i = 0, iMax = Width - 1; i != iMax; i++, dst += 3, src++)
-					*(uint32_t*)dst = _byteswap_ulong(*src) >> 8;
+				KeepCount--;
+				if (FrameSize != Size) { free(Frame); Frame = (uint8_t*)malloc(Size); FrameSize = Size; }
+				CopyFrame(Frame, Buf, Size);
 			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint32_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 24, src += 8)
-				{
-					*(uint32_t*)(dst     ) = _byteswap_ulong(src[0]) >> 8;
-					*(uint32_t*)(dst +  3) = _byteswap_ulong(src[1]) >> 8;
-					*(uint32_t*)(dst +  6) = _byteswap_ulong(src[2]) >> 8;
-					*(uint32_t*)(dst +  9) = _byteswap_ulong(src[3]) >> 8;
-					*(uint32_t*)(dst + 12) = _byteswap_ulong(src[4]) >> 8;
-					*(uint32_t*)(dst + 15) = _byteswap_ulong(src[5]) >> 8;
-					*(uint32_t*)(dst + 18) = _byteswap_ulong(src[6]) >> 8;
-					*(uint32_t*)(dst + 21) = _byteswap_ulong(src[7]) >> 8;
-				}
-				for (; src != srcEnd1; dst += 3, src++)
-					*(uint32_t*)(dst) = _byteswap_ulong(*src) >> 8;
-			}
-			uint32_t FinalPixel = _byteswap_ulong(*src) >> 8;
-			memcpy(dst, &FinalPixel, 3);
+			else if (Frame) { free(Frame); Frame = NULL, FrameSize = 0; }
 		}
+	};
 
-		void RGBA8toBGRA8()
-		{
-			#define RGBATOBGRA(x) ((x&0xFF00FF00)|((x&0x00FF0000)>>16)|((x&0x000000FF)<<16))
-			const uint32_t *src = (const uint32_t*)BufIn + (RowStart * RGBAInStride);
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint32_t *srcEnd = (const uint32_t*)BufIn + ((RowEnd) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcEnd; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst++)
-						*dst = RGBATOBGRA(src[i]);
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint32_t *srcEnd8 = src + (((RowEnd-RowStart)*Width)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width);
-				for (; src != srcEnd8; dst += 8, src += 8)
-				{
-					dst[0] = RGBATOBGRA(src[0]);
-					dst[1] = RGBATOBGRA(src[1]);
-					dst[2] = RGBATOBGRA(src[2]);
-					dst[3] = RGBATOBGRA(src[3]);
-					dst[4] = RGBATOBGRA(src[4]);
-					dst[5] = RGBATOBGRA(src[5]);
-					dst[6] = RGBATOBGRA(src[6]);
-					dst[7] = RGBATOBGRA(src[7]);
-				}
-				for (; src != srcEnd1; dst++, src++)
-					*dst = RGBATOBGRA(*src);
-			}
-			#undef RGBATOBGRA
-		}
+	struct PipelineState
+	{
+		//Sample filled by the conversion thread of the pipelined delivery which waits to be delivered, the conversion thread only starts
+		//filling the next sample once this is taken so there is at most one frame ready in addition to the one being delivered
+		//ReadyEvent gets set with every ready sample so the delivering thread can wait for it together with the command queue
+		std::thread Thread;
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		HANDLE ReadyEvent;
+		IMediaSample* Ready; HRESULT ReadyResult;
+		bool Stopping;
+		bool Enabled; //PipelinedDelivery at the time the buffers got set up (see DecideBufferSize)
+
+		PipelineState() : ReadyEvent(CreateEventA(NULL, FALSE, FALSE, NULL)), Ready(NULL), Stopping(false), Enabled(false) {}
+		~PipelineState() { if (ReadyEvent) CloseHandle(ReadyEvent); }
+	};
 
-		void RGBA16toBGR8()
-		{
-			//16 bit color downscaling (HDR (16 bit floats) to BGR)
-			const uint8_t* ttbl = RGBA16Table;
-			#define RGBAF16toBGRU8(psrc) ((ttbl[((uint16_t*)(psrc))[0]]<<16) | (ttbl[((uint16_t*)(psrc))[1]]<<8) | ttbl[((uint16_t*)(psrc))[2]])
-			const uint64_t *src = (const uint64_t*)BufIn + (RowStart * RGBAInStride);
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			if (RGBAInStride != Width)
-			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint64_t *srcLastRow = (const uint64_t*)BufIn + ((RowEnd - 1) * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcLastRow; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst += 3)
-						*(uint32_t*)dst = RGBAF16toBGRU8(src + i);
-				for (size_t i = 0, iMax = Width - 1; i != iMax; i++, dst += 3, src++)
-					*(uint32_t*)dst = RGBAF16toBGRU8(src);
-			}
-			else
-			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint64_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 24, src += 8)
-				{
-					*(uint32_t*)(dst     ) = RGBAF16toBGRU8(src    );
-					*(uint32_t*)(dst +  3) = RGBAF16toBGRU8(src + 1);
-					*(uint32_t*)(dst +  6) = RGBAF16toBGRU8(src + 2);
-					*(uint32_t*)(dst +  9) = RGBAF16toBGRU8(src + 3);
-					*(uint32_t*)(dst + 12) = RGBAF16toBGRU8(src + 4);
-					*(uint32_t*)(dst + 15) = RGBAF16toBGRU8(src + 5);
-					*(uint32_t*)(dst + 18) = RGBAF16toBGRU8(src + 6);
-					*(uint32_t*)(dst + 21) = RGBAF16toBGRU8(src + 7);
-				}
-				for (; src != srcEnd1; dst += 3, src++)
-					*(uint32_t*)(dst) = RGBAF16toBGRU8(src);
-			}
-			//For the final pixel we can't use 4 byte uint32_t copy so we call memcpy
-			uint32_t FinalPixel = RGBAF16toBGRU8(src);
-			memcpy(dst, &FinalPixel, 3);
-			#undef RGBAF16toBGRU8
-		}
+	void StartPipeline()
+	{
+		m_Pipeline.Ready = NULL, m_Pipeline.Stopping = false;
+		m_Pipeline.Thread = std::thread(PipelineThread, this);
+	}
+
+	void StopPipeline()
+	{
+		{ std::lock_guard<std::mutex> Lock(m_Pipeline.Mutex); m_Pipeline.Stopping = true; }
+		m_Pipeline.Condition.notify_all();
+		m_Pipeline.Thread.join(); //FillBuffer returns after RECEIVE_MAX_WAIT at the latest
+		if (m_Pipeline.Ready) m_Pipeline.Ready->Release();
+		m_Pipeline.Ready = NULL;
+	}
 
-		void RGBA16toBGRA8()
+	static void PipelineThread(CCaptureStream* s)
+	{
+		PipelineState& p = s->m_Pipeline;
+		for (;;)
 		{
-			//16 bit color downscaling (HDR (16 bit floats) to BGRA)
-			const uint8_t* ttbl = RGBA16Table;
-			#define RGBAF16toBGRAU8(psrc) ((ttbl[((uint16_t*)(psrc))[3]]<<24) | (ttbl[((uint16_t*)(psrc))[0]]<<16) | (ttbl[((uint16_t*)(psrc))[1]]<<8) | ttbl[((uint16_t*)(psrc))[2]])
-			const uint64_t *src = (const uint64_t*)BufIn + (RowStart * RGBAInStride);
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			if (RGBAInStride != Width)
 			{
-				//Handle a case where the texture pitch does have a gap on the right side
-				const uint64_t *srcEnd = (const uint64_t*)BufIn + (RowEnd * RGBAInStride);
-				for (size_t srcStride = RGBAInStride, iMax = Width; src != srcEnd; src += srcStride)
-					for (size_t i = 0; i != iMax; i++, dst++)
-						*dst = RGBAF16toBGRAU8(src + i);
+				std::unique_lock<std::mutex> Lock(p.Mutex);
+				while (p.Ready && !p.Stopping) p.Condition.wait(Lock);
+				if (p.Stopping) return;
 			}
-			else
+			//Wait for a free sample, when stopping the allocator gets decommitted before the stop command is sent which ends the wait
+			IMediaSample* pSample;
+			if (FAILED(s->GetDeliveryBuffer(&pSample, NULL, NULL, 0)))
 			{
-				//The fastest (implemented) path to convert from RGBA to BGR
-				const uint64_t *srcEnd8 = src + (((RowEnd-RowStart)*Width-1)&~7), *srcEnd1 = src + ((RowEnd-RowStart)*Width-1);
-				for (; src != srcEnd8; dst += 8, src += 8)
-				{
-					dst[0] = RGBAF16toBGRAU8(src    );
-					dst[1] = RGBAF16toBGRAU8(src + 1);
-					dst[2] = RGBAF16toBGRAU8(src + 2);
-					dst[3] = RGBAF16toBGRAU8(src + 3);
-					dst[4] = RGBAF16toBGRAU8(src + 4);
-					dst[5] = RGBAF16toBGRAU8(src + 5);
-					dst[6] = RGBAF16toBGRAU8(src + 6);
-					dst[7] = RGBAF16toBGRAU8(src + 7);
-				}
-				for (; src != srcEnd1; dst++, src++)
-					*dst = RGBAF16toBGRAU8(src);
+				std::unique_lock<std::mutex> Lock(p.Mutex);
+				p.Condition.wait_for(Lock, std::chrono::milliseconds(SharedImageMemory::RECEIVE_MAX_WAIT), [&p]{ return p.Stopping; }); //stop command of the delivering thread
+				continue;
 			}
-			#undef RGBAF16toBGRAU8
-		}
-
-		void BGRResizeLinear()
-		{
-			const size_t w = Width, h = ResizeToHeight, ResizeFromPitch = ResizeFromWidth * 3;
-			const double aw = (double)w, ah = (double)h;
-			const double scale = max(ResizeFromWidth / aw, ResizeFromHeight / ah);
-			const double ax = (aw - (ResizeFromWidth  / scale)) / 2.0;
-			const double ay = (ah - (ResizeFromHeight / scale)) / 2.0;
-			const uint8_t *src = (const uint8_t*)BufIn, BlackPixel[3] = {0, 0, 0};
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3);
-			for (size_t y = RowStart, yEnd = RowEnd, isMaxW = ResizeFromWidth, isOffsetMax = ResizeFromHeight * ResizeFromPitch; y != yEnd; y++)
-				for (size_t x = 0; x != w; x++, dst += 3)
-				{
-					const size_t isx = (size_t)((x-ax)*scale), isy = (size_t)((y-ay)*scale);
-					const size_t isOffset = (isx > isMaxW ? isOffsetMax : isy * ResizeFromPitch + isx * 3);
-					memcpy(dst, (isOffset >= isOffsetMax ? BlackPixel : src + isOffset), 3);
-				}
-		}
-
-		void BGRAResizeLinear()
-		{
-			const size_t w = Width, h = ResizeToHeight, fromw = ResizeFromWidth;
-			const double aw = (double)w, ah = (double)h;
-			const double scale = max(ResizeFromWidth / aw, ResizeFromHeight / ah);
-			const double ax = (aw - (ResizeFromWidth  / scale)) / 2.0;
-			const double ay = (ah - (ResizeFromHeight / scale)) / 2.0;
-			const uint32_t *src = (const uint32_t*)BufIn;
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width);
-			for (size_t y = RowStart, yEnd = RowEnd, isMaxW = ResizeFromWidth, isOffsetMax = ResizeFromHeight * fromw; y != yEnd; y++)
-				for (size_t x = 0; x != w; x++, dst++)
-				{
-					const size_t isx = (size_t)((x-ax)*scale), isy = (size_t)((y-ay)*scale);
-					const size_t isOffset = (isx > isMaxW ? isOffsetMax : isy * fromw + isx);
-					*dst = (isOffset >= isOffsetMax ? 0 : src[isOffset]);
-				}
-			UCASSERT(dst ==  (uint32_t*)BufOut + (RowEnd * Width));
-		}
-
-		void BGRMirrorHorizontal()
-		{
-			uint8_t *dst = (uint8_t*)BufOut + (RowStart * Width * 3), *dstEnd = (uint8_t*)BufOut + (RowEnd * Width * 3);
-			for (size_t dstPitch = Width * 3; dst != dstEnd; dst += dstPitch)
-				for (uint8_t tmp[3], *dstA = dst, *dstB = dst + dstPitch - 3; dstA < dstB; dstA += 3, dstB -= 3)
-					memcpy(tmp, dstA, 3), memcpy(dstA, dstB, 3), memcpy(dstB, tmp, 3);
+			const HRESULT hr = s->FillBuffer(pSample);
+			{ std::lock_guard<std::mutex> Lock(p.Mutex); p.Ready = pSample, p.ReadyResult = hr; }
+			SetEvent(p.ReadyEvent);
+			if (hr != S_OK) return; //the delivering thread ends the stream
 		}
+	}
 
-		void BGRAMirrorHorizontal()
-		{
-			uint32_t *dst = (uint32_t*)BufOut + (RowStart * Width), *dstEnd = (uint32_t*)BufOut + (RowEnd * Width);
-			for (size_t w = Width; dst != dstEnd; dst += w)
-				for (uint32_t tmp, *dstA = dst, *dstB = dst + w - 1; dstA < dstB; dstA++, dstB--)
-					tmp = *dstA, *dstA = *dstB, *dstB = tmp;
-		}
-	};
-
-	struct ProcessWorkers
+	struct ErrorPatternState
 	{
-		ProcessWorkers() : WorkersRunning(WORKERCOUNT)
-		{
-			for (size_t i = 0; i != WORKERCOUNT; i++) Threads[i].Start((sThread::FUNC_t)&ProcessThread, (void*)this);
-		}
+		//Last drawn error pattern with what it was drawn for
+		EErrorDrawMode Mode; ProcessJob::EOutput Output; EYUVColorSpace YUVColorSpace; int Width, Height; char Text[512];
+		uint8_t* Frame; size_t Size;
 
-		~ProcessWorkers()
-		{
-			WorkersRunning = 0;
-			for (size_t i = 0; i != WORKERCOUNT; i++) NewJobSemaphore.Post(); //wake up all threads
-		}
-	
-		void StartNewJob(ProcessJob NewJob)
-		{
-			//Notify threads of new work to do
-			WorkingJobCount = 0;
-			size_t Num = NewJob.RowEnd;
-			for (size_t i = 0; i != WORKERCOUNT; i++)
-			{
-				NewJob.RowStart = Num * (i  ) / (WORKERCOUNT + 1);
-				NewJob.RowEnd   = Num * (i+1) / (WORKERCOUNT + 1);
-				Jobs[i] = NewJob;
-				NewJobSemaphore.Post();
-			}
-
-			//Do work in the main thread as well
-			NewJob.RowStart = NewJob.RowEnd;
-			NewJob.RowEnd   = Num;
-			NewJob.Execute();
-
-			//Wait for threads to finish working
-			for (size_t i = 0; i != WORKERCOUNT && JobDoneSemaphore.WaitForPost(); i++) {}
-		}
-
-	private:
-		//Wrapper objects for Windows concurrency objects (thread, mutex, semaphore)
-		struct sThread { typedef DWORD (WINAPI *FUNC_t)(LPVOID); sThread() : h(0) {} sThread(FUNC_t f, void* p = NULL) : h(0) { Start(f, p); } void Start(FUNC_t f, void* p = NULL) { if (h) this->~sThread(); h = CreateThread(0,0,f,p,0,0); } ~sThread() { if (h) { WaitForSingleObject(h, INFINITE); CloseHandle(h); } } private:HANDLE h;sThread(const sThread&);sThread& operator=(const sThread&);};
-		struct sMutex { sMutex() : h(CreateMutexA(0,0,0)) {} ~sMutex() { CloseHandle(h); } __inline void Lock() { WaitForSingleObject(h,INFINITE); } __inline void Unlock() { ReleaseMutex(h); } private:HANDLE h;sMutex(const sMutex&);sMutex& operator=(const sMutex&);};
-		struct sSemaphore { sSemaphore() : h(CreateSemaphoreA(0,0,32768,0)) {} ~sSemaphore() { CloseHandle(h); } __inline void Post() { ReleaseSemaphore(h, 1, 0); } __inline bool WaitForPost() { return WaitForSingleObject(h,INFINITE) == WAIT_OBJECT_0; } private:HANDLE h;sSemaphore(const sSemaphore&);sSemaphore& operator=(const sSemaphore&);};
-
-		enum { WORKERCOUNT = 3 };
-		sMutex JobsMutex;
-		sThread Threads[WORKERCOUNT];
-		ProcessJob Jobs[WORKERCOUNT];
-		sSemaphore NewJobSemaphore, JobDoneSemaphore;
-		size_t WorkingJobCount, WorkersRunning;
-
-		static void ProcessThread(ProcessWorkers* mw)
-		{
-			while (mw->NewJobSemaphore.WaitForPost() && mw->WorkersRunning)
-			{
-				mw->JobsMutex.Lock();
-				size_t MyJob = mw->WorkingJobCount++;
-				mw->JobsMutex.Unlock();
-				mw->Jobs[MyJob].Execute();
-				mw->JobDoneSemaphore.Post();
-			}
-		}
+		ErrorPatternState() : Frame(NULL), Size(0) {}
+		~ErrorPatternState() { free(Frame); }
 	};
 
 	struct ProcessState
 	{
 		uint8_t* Buf;
 		int BufWidth, BufHeight, BufBPP;
+		ProcessJob::EOutput Output;
 		CCaptureStream* Owner;
+		YUVCoeffs YUV;
+		EYUVColorSpace YUVColorSpace; //what YUV got set up for (only with YUV output)
 	};
 
-	static void ProcessImage(int InWidth, int InHeight, int InStride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, int Timeout, uint8_t* InBuf, ProcessState* State)
+	static void ProcessImage(int InWidth, int InHeight, int InStride, SharedImageMemory::EFormat Format, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, SharedImageMemory::EAlphaMode AlphaMode, int Timeout, uint8_t* InBuf, uint32_t Sequence, SharedImageMemory::FrameStats* Stats, ProcessState* State)
 	{
 		//Set maximum number of missed frames allowed until we show sending as having stopped
 		State->Owner->m_llFrameMissMax = (Timeout + SharedImageMemory::RECEIVE_MAX_WAIT - 1) / SharedImageMemory::RECEIVE_MAX_WAIT;
 
+		//With 90 degree rotation the output gets compared to (and resized from) the turned image so swap the dimensions from here on
+		const bool Rotate = (MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_90 || MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_270);
+		if (Rotate) { int Tmp = InWidth; InWidth = InHeight; InHeight = Tmp; }
+
+		//Rotated rows read from every source row so they can't be tracked in tiles
+		const bool UseDirtyTiles = (DirtyTiles && !Rotate); //read once as it can be changed from the property page at any time
+		if (!UseDirtyTiles) State->Owner->m_DirtyTiles.Release();
+
 		const bool NeedResize = (InWidth != State->BufWidth || InHeight != State->BufHeight);
 		if (NeedResize && ResizeMode == SharedImageMemory::RESIZEMODE_DISABLED)
 		{
@@ -474,72 +379,205 @@ private:
 			return;
 		}
 
-		if (NeedResize)
+		//Output the last converted frame again if the data hasn't changed since (Unity didn't send a new frame in time)
+		LastFrameState& Last = State->Owner->m_LastFrame;
+		LastFrameState::Key Key = { Sequence, State->Output, State->BufWidth, State->BufHeight, State->YUVColorSpace, BackgroundMode };
+		const bool Repeated = !memcmp(&Key, &Last.LastKey, sizeof(Key));
+		if (Repeated) Last.KeepCount = LastFrameState::KEEP_FRAMES;
+		if (Repeated && Last.Frame)
 		{
-			//Prepare buffer for image scaling
-			DWORD UnscaledBufSize = (InWidth * InHeight * State->BufBPP);
-			if (State->Owner->m_iUnscaledBufSize != UnscaledBufSize)
-			{
-				if (State->Owner->m_pUnscaledBuf) free(State->Owner->m_pUnscaledBuf);
-				State->Owner->m_pUnscaledBuf = (uint8_t*)malloc(UnscaledBufSize);
-				State->Owner->m_iUnscaledBufSize = UnscaledBufSize;
-			}
+			CopyFrame(State->Buf, Last.Frame, ProcessJob::GetOutputSize(State->Output, State->BufWidth, State->BufHeight));
+			State->Owner->m_DirtyTiles.LastDirty = 0;
+			if (Stats) Stats->frames++, Stats->dirtytiles = 0; //the rest is still the same
+			return;
 		}
-
-		if (Format != SharedImageMemory::FORMAT_UINT8 && (!State->Owner->m_RGBA16Table || State->Owner->m_RGBA16TableFormat != Format))
+		Last.LastKey = Key;
+
+		//16 bit float sources get mapped to 8 bit (or 12 bit for the 10 bit outputs) through tables that are shared by all streams
+		//The 8 bit table is only needed on CPUs without F16C as the AVX2 kernels convert half floats directly (unless an HDR curve is used)
+		//Linear sources get encoded with the PQ or HLG curve, the BT.2020 primaries and matrix for 10 bit output if one of the HDR modes is selected
+		const bool HalfFloat = (Format == SharedImageMemory::FORMAT_FP16_GAMMA || Format == SharedImageMemory::FORMAT_FP16_LINEAR);
+		const bool HDR = (Format == SharedImageMemory::FORMAT_FP16_LINEAR && State->Output >= ProcessJob::OUT_P010 && (State->YUVColorSpace == YCS_BT2100_PQ || State->YUVColorSpace == YCS_BT2100_HLG));
+		const ProcessJob::ETransfer Transfer = (HDR ? (State->YUVColorSpace == YCS_BT2100_PQ ? ProcessJob::TRANSFER_PQ : ProcessJob::TRANSFER_HLG) : (Format == SharedImageMemory::FORMAT_FP16_LINEAR ? ProcessJob::TRANSFER_SRGB : ProcessJob::TRANSFER_GAMMA));
+		const uint8_t* RGBA16Table = (HalfFloat && (SIMDLevel < SIMD_AVX2 || HDR) ? ProcessJob::GetRGBA16Table(Transfer) : NULL);
+		const uint16_t* RGBA16Table12 = (HalfFloat && State->Output >= ProcessJob::OUT_P010 ? ProcessJob::GetRGBA16Table12(Transfer) : NULL);
+		const bool Deep = (RGBA16Table12 != NULL); //all steps keep 12 bits per channel, so rotation turns the unconverted source pixels
+
+		//Multi-threaded conversion of RGBA source to 8-bit BGR or YUV format with mirroring and flipping done in the same pass
+		//When resizing, the conversion happens per source row inside the resampler which scales the mirrored rows directly into the output
+		//If the sender asks for statistics, the final pass collects them per thread while writing the output rows
+		ProcessJob Job, RotateJob;
+		ProcessStats Collected;
+		ProcessWorkers::RowMap Map;
+		ProcessJob::EInput In = GetInputFormat(Format);
+		const bool Mirror = (MirrorMode == SharedImageMemory::MIRRORMODE_HORIZONTALLY || MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_180);
+		const bool VFlip = (MirrorMode == SharedImageMemory::MIRRORMODE_VERTICALLY || MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_180);
+		Job.RGBA16Table = RGBA16Table, Job.RGBA16Table12 = RGBA16Table12, Job.WideGamut = HDR, Job.YUV = State->YUV, Job.FlipSource = VFlip;
+		if (HDR) Job.YUV.Set(YUVCoeffs::MATRIX_BT2020, false, true);
+		Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = (ProcessJob::EAlpha)AlphaMode, Job.StreamOut = false, Job.Stats = NULL;
+		if (Rotate)
 		{
-			//Build a 64k table that maps 16 bit float values (either linear SRGB or gamma RGB) to 8 bit color values
-			const bool SRGB = (Format == SharedImageMemory::FORMAT_FP16_LINEAR);
-			uint8_t* RGBA16Table = State->Owner->m_RGBA16Table;
-			if (!RGBA16Table) RGBA16Table = State->Owner->m_RGBA16Table = (uint8_t*)malloc(0xFFFF+1);
-			for(int i = 0; i <= 0xFFFF; i++)
+			//Turn the image into BGRA first (straight into the output for BGRA without resizing), the steps below then read that as a BGRA8 source
+			//The alpha conversion is only done by the rotation if it is the last step as it would otherwise be applied twice
+			//For 10 bit output of 16 bit floats the source pixels get turned as they are and the steps below read them like the source
+			uint8_t* Rotated = (State->Output == ProcessJob::OUT_BGRA && !NeedResize ? State->Buf : State->Owner->GetScratchBuffer(InWidth * InHeight * (Deep ? 8 : 4)));
+			if (Rotated != State->Buf) Job.AlphaMode = ProcessJob::ALPHA_KEEP;
+			Job.Kernel = (Deep ? ProcessJob::GetRotateRawKernel(MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_90) : ProcessJob::GetRotateKernel(In, (MirrorMode == SharedImageMemory::MIRRORMODE_ROTATE_90)));
+			Job.BufIn = InBuf, Job.BufOut = Rotated, Job.RGBAInStride = InStride;
+			Job.Width = InWidth, Job.Height = InHeight, Job.RowStart = 0, Job.RowEnd = InHeight;
+			if (Rotated == State->Buf)
 			{
-				float f;
-				(i & 0x8000 ? f = 0 : (*(uint32_t*)&f = (i << 13) + 0x38000000));
-				if (SRGB) f = (f <= 0.0031308f ? (f * 12.92f) : (powf(f, 1.0f / 2.4f) * 1.055f - 0.055f));
-				RGBA16Table[i] = (f < 1.0f ? (uint8_t)(f * 255.9999f) : 255);
+				Job.Stats = (Stats ? &Collected : NULL);
+				State->Owner->m_ProcessWorkers.StartNewJob(Job);
+				if (Stats) PublishStats(Stats, Collected, State);
+				Last.Store(State->Buf, ProcessJob::GetOutputSize(State->Output, State->BufWidth, State->BufHeight));
+				return;
 			}
-			State->Owner->m_RGBA16TableFormat = Format;
+			RotateJob = Job; //gets run in chunks by the workers of the final pass below, the chunks of that only wait for the rows they read
+			In = (Deep ? In : ProcessJob::IN_BGRA8), InBuf = Rotated, InStride = InWidth, Job.AlphaMode = (ProcessJob::EAlpha)AlphaMode;
+		}
+		Job.BufIn = InBuf, Job.BufOut = State->Buf, Job.RGBAInStride = InStride;
+		//RGB output frames that don't fit into the last level cache get written with non-temporal stores so they don't evict the source image
+		Job.StreamOut = (State->Output <= ProcessJob::OUT_BGRA && (size_t)State->BufWidth * State->BufHeight * State->BufBPP > SharedImageMemory::GetLastLevelCacheSize());
+		if (State->Output == ProcessJob::OUT_BGR && BackgroundMode != BGM_NONE) Job.Background = State->Owner->GetBackground(State->BufWidth, State->BufHeight, &Job.BackgroundPitch);
+		const int DownscaleFactor = (InWidth % State->BufWidth || InHeight % State->BufHeight || InWidth / State->BufWidth != InHeight / State->BufHeight ? 0 : InWidth / State->BufWidth);
+		if (NeedResize && DownscaleFactor >= 2 && DownscaleFactor <= 4 && ResizeMode == SharedImageMemory::RESIZEMODE_AREA)
+		{
+			//Exact downscales with area sampling are a plain box filter, the other modes keep their filter shape at every ratio
+			Job.Kernel = ProcessJob::GetDownscaleKernel(In, State->Output, Mirror, DownscaleFactor);
+			Job.Width = State->BufWidth, Job.Height = State->BufHeight, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
+			Job.Coeffs = NULL, Map.Scale = DownscaleFactor, Map.Flip = VFlip;
+		}
+		else if (NeedResize)
+		{
+			State->Owner->m_ResizeCoeffs.Update(InWidth, InHeight, State->BufWidth, State->BufHeight, ResizeMode);
+			Job.Kernel = ProcessJob::GetResizeKernel(In, State->Output, Mirror);
+			Job.Width = State->BufWidth, Job.Height = State->BufHeight, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
+			Job.Coeffs = &State->Owner->m_ResizeCoeffs, Map.Scale = 0, Map.Flip = VFlip;
 		}
+		else
+		{
+			Job.Kernel = ProcessJob::GetConvertKernel(In, State->Output, Mirror, VFlip);
+			Job.Width = InWidth, Job.Height = InHeight, Job.RowStart = 0, Job.RowEnd = InHeight;
+			Job.Coeffs = NULL, Map.Scale = 1, Map.Flip = (VFlip && State->Output >= ProcessJob::OUT_NV12); //RGB chunks walk the source rows and flip while writing
+		}
+		Map.SrcHeight = InHeight, Map.BottomUp = (State->Output >= ProcessJob::OUT_NV12), Map.Coeffs = Job.Coeffs;
+		Job.Stats = (Stats ? &Collected : NULL);
+		if (UseDirtyTiles) State->Owner->ConvertChangedTiles(Job, Map, SharedImageMemory::GetBytesPerPixel(Format), InWidth, InHeight, InStride, ResizeMode, State);
+		else State->Owner->m_ProcessWorkers.StartNewJob(Job, (Rotate ? &RotateJob : NULL), &Map);
+		if (Stats) PublishStats(Stats, Collected, State);
+		Last.Store(State->Buf, ProcessJob::GetOutputSize(State->Output, State->BufWidth, State->BufHeight));
+	}
 
-		//Multi-threaded conversion of RGBA source to 8-bit BGR format while also eliminating possible row gaps (when stride != width)
-		ProcessJob Job;
-		if (State->BufBPP == 4) Job.Type = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::JOB_RGBA8toBGRA8 : ProcessJob::JOB_RGBA16toBGRA8);
-		else                    Job.Type = (Format == SharedImageMemory::FORMAT_UINT8 ? ProcessJob::JOB_RGBA8toBGR8  : ProcessJob::JOB_RGBA16toBGR8 );
-		Job.BufIn = InBuf, Job.BufOut = (NeedResize ? State->Owner->m_pUnscaledBuf : State->Buf);
-		Job.Width = InWidth, Job.RowStart = 0, Job.RowEnd = InHeight, Job.RGBAInStride = InStride;
-		Job.RGBA16Table = State->Owner->m_RGBA16Table;
-		State->Owner->m_ProcessWorkers.StartNewJob(Job);
-
-		if (NeedResize)
+	void ConvertChangedTiles(ProcessJob Job, const ProcessWorkers::RowMap& Map, int InBPP, int InWidth, int InHeight, int InStride, int ResizeMode, ProcessState* State)
+	{
+		//Hash the source in tiles of full rows and only convert the output rows that read from tiles which changed since the last frame
+		//The rows get converted into a persistent frame which then gets copied into the sample (the samples don't keep their content)
+		//Statistics need every pixel so with them the whole frame gets converted, the changed tiles still get counted for the ratio
+		enum { TILE_ROWS = ProcessJob::TILE_ROWS };
+		DirtyTileState& d = m_DirtyTiles;
+		const size_t SrcTiles = (InHeight + TILE_ROWS - 1) / TILE_ROWS, OutTiles = (Job.RowEnd + TILE_ROWS - 1) / TILE_ROWS;
+		DirtyTileState::Key k;
+		memset(&k, 0, sizeof(k)); //compared with memcmp
+		k.Kernel = Job.Kernel, k.Table = Job.RGBA16Table, k.Table12 = Job.RGBA16Table12, k.Background = Job.Background, k.BackgroundPitch = Job.BackgroundPitch;
+		k.BackgroundMode = (Job.Background ? m_BackgroundMode : BGM_NONE); //solid colors can get reallocated at the same address with the same pitch
+		if (State->Output >= ProcessJob::OUT_NV12) k.YUV = Job.YUV; //not set up for RGB output
+		k.Width = Job.Width, k.Height = Job.Height, k.Size = ProcessJob::GetOutputSize(State->Output, State->BufWidth, State->BufHeight);
+		k.InWidth = InWidth, k.InHeight = InHeight, k.InStride = InStride, k.InBPP = InBPP, k.ResizeMode = ResizeMode, k.AlphaMode = Job.AlphaMode, k.FlipSource = Job.FlipSource;
+		if (memcmp(&k, &d.LastKey, sizeof(k)))
 		{
-			//Multi-threaded image scaling
-			Job.Type = (State->BufBPP == 4 ? ProcessJob::JOB_BGRA_RESIZE_LINEAR : ProcessJob::JOB_BGR_RESIZE_LINEAR);
-			Job.BufIn = State->Owner->m_pUnscaledBuf, Job.BufOut = State->Buf;
-			Job.Width = State->BufWidth, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
-			Job.ResizeToHeight = State->BufHeight, Job.ResizeFromWidth = InWidth, Job.ResizeFromHeight = InHeight;
-			State->Owner->m_ProcessWorkers.StartNewJob(Job);
+			d.Release();
+			d.Hashes = (uint64_t*)malloc(SrcTiles * 2 * sizeof(uint64_t)), d.Tiles = (uint32_t*)malloc(OutTiles * sizeof(uint32_t)), d.Frame = (uint8_t*)malloc(k.Size);
+			memcpy(&d.LastKey, &k, sizeof(k));
 		}
 
-		if (MirrorMode == SharedImageMemory::MIRRORMODE_HORIZONTALLY)
+		//The hashes of the current frame get written behind the ones of the last converted frame
+		ProcessJob Hash = Job;
+		uint64_t *Old = d.Hashes, *New = d.Hashes + SrcTiles;
+		Hash.Kernel = &ProcessJob::HashTiles, Hash.BufOut = New, Hash.Width = InWidth * InBPP, Hash.Height = InHeight, Hash.RGBAInStride = InStride * InBPP;
+		Hash.RowStart = 0, Hash.RowEnd = SrcTiles, Hash.StreamOut = false, Hash.Stats = NULL;
+		m_ProcessWorkers.StartNewJob(Hash);
+
+		//Output rows outside of a letterboxed image read no source rows and only need converting once
+		ProcessJob Rows = Job;
+		size_t Count = 0;
+		for (size_t o = 0; o != OutTiles; o++)
 		{
-			//Multi-threaded horizontal image flipping
-			Job.Type = (State->BufBPP == 4 ? ProcessJob::JOB_BGRA_MIRROR_HORIZONTAL : ProcessJob::JOB_BGR_MIRROR_HORIZONTAL);
-			Job.BufOut = State->Buf;
-			Job.Width = State->BufWidth, Job.RowStart = 0, Job.RowEnd = State->BufHeight;
-			State->Owner->m_ProcessWorkers.StartNewJob(Job);
+			size_t Start, End;
+			Rows.RowStart = o * TILE_ROWS, Rows.RowEnd = min(Job.RowEnd, (o + 1) * TILE_ROWS);
+			ProcessWorkers::GetSourceRows(Rows, Map, &Start, &End);
+			bool Dirty = !d.Valid;
+			for (size_t t = Start / TILE_ROWS; !Dirty && t < (End + TILE_ROWS - 1) / TILE_ROWS; t++) Dirty = (Old[t] != New[t]);
+			if (Dirty) d.Tiles[Count++] = (uint32_t)o;
 		}
+		memcpy(Old, New, SrcTiles * sizeof(uint64_t));
+
+		Job.BufOut = d.Frame, Job.StreamOut = false;
+		if (!d.Valid || Job.Stats) m_ProcessWorkers.StartNewJob(Job);
+		else if (Count) m_ProcessWorkers.StartTileJob(Job, d.Tiles, Count);
+		CopyFrame(State->Buf, d.Frame, k.Size);
+		d.Valid = true, d.LastTiles = (uint32_t)OutTiles, d.LastDirty = (uint32_t)Count;
+	}
+
+	static void CopyFrame(uint8_t* Dst, const uint8_t* Src, size_t Size)
+	{
+		//Frames that don't fit into the last level cache get written with non-temporal stores like the conversion does it
+		if (Size > SharedImageMemory::GetLastLevelCacheSize()) StreamingCopy(Dst, Src, Size);
+		else memcpy(Dst, Src, Size);
+	}
+
+	static void PublishStats(SharedImageMemory::FrameStats* Stats, const ProcessStats& Collected, const ProcessState* State)
+	{
+		//Hand the statistics collected by the kernels to the sender, outputs without alpha channel count all pixels as opaque
+		const bool Alpha = (State->Output == ProcessJob::OUT_BGRA);
+		Stats->frames++;
+		Stats->width = State->BufWidth, Stats->height = State->BufHeight;
+		Stats->transparent = (uint32_t)(Alpha ? Collected.TransparentPixels : 0), Stats->opaque = (uint32_t)(Alpha ? Collected.OpaquePixels : Collected.Pixels);
+		Stats->tiles = State->Owner->m_DirtyTiles.LastTiles, Stats->dirtytiles = State->Owner->m_DirtyTiles.LastDirty;
+		Stats->lumasum = Collected.LumaSum, Stats->alphasum = (Alpha ? Collected.AlphaSum : Collected.Pixels * 255);
+		Collected.GetHistogram(Stats->histogram);
 	}
 
 	static void FillErrorPattern(EErrorDrawMode edm, ProcessState* State, int LineCount = 0, char** LineStrings = NULL, int* LineLengths = NULL, LONGLONG FrameNumber = -1)
 	{
 		if (FrameNumber >= 0 && FrameNumber < 5) edm = EDM_BLACK; //show errors as just black during the first 5 frames (when starting)
+		if (edm == EDM_BLACK && State->Output < ProcessJob::OUT_NV12) { ZeroMemory(State->Buf, State->BufWidth * State->BufHeight * State->BufBPP); return; }
+
+		//The pattern only gets drawn when the mode, output format, color space, size or text changes, otherwise the last drawn one just gets copied
+		ErrorPatternState& e = State->Owner->m_ErrorPattern;
+		char Text[sizeof(e.Text)];
+		int TextLen = 0;
+		for (int i = 0; i < LineCount; i++) TextLen += sprintf_s(Text + TextLen, sizeof(Text) - TextLen, "%.*s\n", LineLengths[i], LineStrings[i]);
+		Text[TextLen] = '\0';
+		const size_t Size = ProcessJob::GetOutputSize(State->Output, State->BufWidth, State->BufHeight);
+		if (!e.Frame || e.Mode != edm || e.Output != State->Output || e.YUVColorSpace != State->YUVColorSpace || e.Width != State->BufWidth || e.Height != State->BufHeight || strcmp(e.Text, Text))
+		{
+			if (!e.Frame || e.Size != Size) { free(e.Frame); e.Frame = (uint8_t*)malloc(Size); e.Size = Size; }
+			e.Mode = edm, e.Output = State->Output, e.YUVColorSpace = State->YUVColorSpace, e.Width = State->BufWidth, e.Height = State->BufHeight;
+			strcpy_s(e.Text, sizeof(e.Text), Text);
+			ProcessState Cached = *State;
+			Cached.Buf = e.Frame;
+			DrawErrorPattern(edm, &Cached, LineCount, LineStrings, LineLengths);
+		}
+		CopyFrame(State->Buf, e.Frame, Size);
+	}
+
+	static void DrawErrorPattern(EErrorDrawMode edm, ProcessState* State, int LineCount, char** LineStrings, int* LineLengths)
+	{
+		if (State->Output >= ProcessJob::OUT_NV12)
+		{
+			//For YUV output the pattern is drawn as BGRA into a scratch buffer which then gets converted like a received frame
+			ProcessState BGRAState = { State->Owner->GetScratchBuffer(State->BufWidth * State->BufHeight * 4), State->BufWidth, State->BufHeight, 4, ProcessJob::OUT_BGRA, State->Owner };
+			DrawErrorPattern(edm, &BGRAState, LineCount, LineStrings, LineLengths);
+			ConvertBGRAToYUV(State, BGRAState.Buf, 0, true);
+			return;
+		}
 		BYTE *p = State->Buf, *pEnd = State->Buf + (State->BufWidth * State->BufHeight * State->BufBPP), SkipCount = State->BufBPP - 3;
 		switch (edm)
 		{
-			case EDM_GREENKEY:    while (p != pEnd) { *(p++) = 0x00; *(p++) = 0xFE; *(p++) = 0x00;           p += SkipCount; } break; //Filled with 0x00FE00 (BGR colors)
-			case EDM_GREENYELLOW: while (p != pEnd) { *(p++) = 0x00; *(p++) = 0xFF; *(p++) = (size_t)p%0xFF; p += SkipCount; } break; //Green/yellow color pattern (BGR colors)
-			case EDM_BLUEPINK:    while (p != pEnd) { *(p++) = 0xFF; *(p++) = 0x00; *(p++) = (size_t)p%0xFF; p += SkipCount; } break; //Blue/pink color pattern (BGR colors)
+			case EDM_GREENKEY:    for (; p != pEnd; p += 3 + SkipCount) { p[0] = 0x00; p[1] = 0xFE; p[2] = 0x00; } break; //Filled with 0x00FE00 (BGR colors)
+			case EDM_GREENYELLOW: for (; p != pEnd; p += 3 + SkipCount) { p[0] = 0x00; p[1] = 0xFF; p[2] = (BYTE)((p + 2 - State->Buf) % 0xFF); } break; //Green/yellow color pattern (BGR colors)
+			case EDM_BLUEPINK:    for (; p != pEnd; p += 3 + SkipCount) { p[0] = 0xFF; p[1] = 0x00; p[2] = (BYTE)((p + 2 - State->Buf) % 0xFF); } break; //Blue/pink color pattern (BGR colors)
 			case EDM_BLACK:       ZeroMemory(State->Buf, (State->BufWidth * State->BufHeight * State->BufBPP)); break; //Filled with black
 		}
 
@@ -570,22 +608,155 @@ private:
 		static LONGLONG MyFPS = 0, MyLastFPSTime = GetTickCount64(), MyLastFPS = 0;
 		for (MyFPS++; GetTickCount64() - MyLastFPSTime > 1000; MyFPS = 0, MyLastFPSTime += 1000) { MyLastFPS = MyFPS; }
 		char DisplayString[128];
-		int DisplayStringLen = sprintf_s(DisplayString, sizeof(DisplayString), "%d FPS", MyLastFPS);
+		const DirtyTileState& d = State->Owner->m_DirtyTiles;
+		int DisplayStringLen = (d.LastTiles ? sprintf_s(DisplayString, sizeof(DisplayString), "%d FPS (%s, %d%% of tiles changed)", (int)MyLastFPS, SIMDLevelNames[SIMDLevel], (int)(d.LastDirty * 100 / d.LastTiles))
+			: sprintf_s(DisplayString, sizeof(DisplayString), "%d FPS (%s)", (int)MyLastFPS, SIMDLevelNames[SIMDLevel]));
 
+		//With YUV output the text is drawn as BGRA and converted into the bottom rows, with an odd height (4:2:0) one more row to start on a row pair
+		const bool YUV = (State->Output >= ProcessJob::OUT_NV12);
+		const int TextHeight = (YUV ? State->BufHeight - ((State->BufHeight - 20) & ~1) : 20), TextBPP = (YUV ? 4 : State->BufBPP);
 		void* pTextBuf;
 		HDC TextDC = CreateCompatibleDC(0);
-		BITMAPINFO TextBMI = { sizeof(BITMAPINFOHEADER), State->BufWidth, 20, 1, 8 * State->BufBPP, 0, 20 * State->BufWidth * State->BufBPP };
+		BITMAPINFO TextBMI = { sizeof(BITMAPINFOHEADER), State->BufWidth, TextHeight, 1, 8 * TextBPP, 0, TextHeight * State->BufWidth * TextBPP };
 		HBITMAP TextHBitmap = CreateDIBSection(TextDC, &TextBMI, DIB_RGB_COLORS, &pTextBuf, NULL, 0);
 		SelectObject(TextDC, TextHBitmap);
 		SetBkMode(TextDC, TRANSPARENT);
 		SetTextColor(TextDC, RGB(0, 255, 0));
-		TextOutA(TextDC, 10, 0, DisplayString, DisplayStringLen);
-		if (State->BufBPP == 4) for (BYTE *p = (BYTE*)pTextBuf, *pEnd = p + 20 * State->BufWidth * 4; p != pEnd; p += 4) p[3] = 0xFF;
-		memcpy(State->Buf, pTextBuf, TextBMI.bmiHeader.biHeight * State->BufWidth * State->BufBPP);
+		TextOutA(TextDC, 10, TextHeight - 20, DisplayString, DisplayStringLen);
+		if (YUV) ConvertBGRAToYUV(State, (uint8_t*)pTextBuf, State->BufHeight - TextHeight, false);
+		else
+		{
+			if (State->BufBPP == 4) for (BYTE *p = (BYTE*)pTextBuf, *pEnd = p + 20 * State->BufWidth * 4; p != pEnd; p += 4) p[3] = 0xFF;
+			memcpy(State->Buf, pTextBuf, TextBMI.bmiHeader.biHeight * State->BufWidth * State->BufBPP);
+		}
 		DeleteObject(TextHBitmap);
 		DeleteDC(TextDC);
 	}
 
+	static void ConvertBGRAToYUV(ProcessState* State, const uint8_t* BGRA, int FirstRow, bool MultiThreaded)
+	{
+		//Convert a bottom-up BGRA image (holding the output rows from FirstRow to the bottom) to the YUV output format
+		//Source rows get read at index Height - 1 - y so the buffer only needs to hold the rows that get converted
+		ProcessJob Job;
+		Job.Kernel = ProcessJob::GetConvertKernel(ProcessJob::IN_BGRA8, State->Output, false, false);
+		Job.BufIn = BGRA, Job.BufOut = State->Buf, Job.RGBAInStride = State->BufWidth, Job.RGBA16Table = NULL, Job.RGBA16Table12 = NULL, Job.WideGamut = false, Job.YUV = State->YUV, Job.FlipSource = false;
+		Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+		Job.Width = State->BufWidth, Job.Height = State->BufHeight, Job.RowStart = FirstRow, Job.RowEnd = State->BufHeight;
+		if (MultiThreaded) State->Owner->m_ProcessWorkers.StartNewJob(Job);
+		else Job.Execute();
+	}
+
+	uint8_t* GetScratchBuffer(size_t Size)
+	{
+		if (m_ScratchBufSize < Size)
+		{
+			if (m_pScratchBuf) free(m_pScratchBuf);
+			m_pScratchBuf = (uint8_t*)malloc(Size);
+			m_ScratchBufSize = Size;
+		}
+		return m_pScratchBuf;
+	}
+
+	const uint32_t* GetBackground(int Width, int Height, size_t* Pitch)
+	{
+		//Solid colors are a single row that gets used for every output row, the image gets scaled to the output size (once per size change)
+		const EBackgroundMode Mode = BackgroundMode; //read once as it can be changed from the property page at any time
+		if (Mode == BGM_IMAGE && !m_BackgroundImageLoaded) LoadBackgroundImage();
+		const bool Image = (Mode == BGM_IMAGE && m_pBackgroundImage);
+		*Pitch = (Image ? Width : 0);
+		if (m_pBackground && m_BackgroundMode == Mode && m_BackgroundWidth == Width && m_BackgroundHeight == Height) return m_pBackground;
+		if (m_pBackground) free(m_pBackground);
+		m_pBackground = (uint32_t*)malloc(Width * (Image ? Height : 1) * 4);
+		m_BackgroundMode = Mode, m_BackgroundWidth = Width, m_BackgroundHeight = Height;
+		if (Image)
+		{
+			ResizeCoeffs Coeffs;
+			ProcessJob Job;
+			const bool NeedResize = (m_BackgroundImageWidth != Width || m_BackgroundImageHeight != Height);
+			if (NeedResize) Coeffs.Update(m_BackgroundImageWidth, m_BackgroundImageHeight, Width, Height, SharedImageMemory::RESIZEMODE_LINEAR);
+			Job.Kernel = (NeedResize ? ProcessJob::GetResizeKernel(ProcessJob::IN_BGRA8, ProcessJob::OUT_BGRA, false) : ProcessJob::GetConvertKernel(ProcessJob::IN_BGRA8, ProcessJob::OUT_BGRA, false, false));
+			Job.BufIn = m_pBackgroundImage, Job.BufOut = m_pBackground, Job.RGBAInStride = m_BackgroundImageWidth, Job.RGBA16Table = NULL, Job.RGBA16Table12 = NULL, Job.WideGamut = false, Job.Coeffs = &Coeffs, Job.FlipSource = false;
+			Job.Background = NULL, Job.BackgroundPitch = 0, Job.AlphaMode = ProcessJob::ALPHA_KEEP, Job.StreamOut = false, Job.Stats = NULL;
+			Job.Width = Width, Job.Height = Height, Job.RowStart = 0, Job.RowEnd = Height;
+			Job.Execute();
+		}
+		else
+		{
+			const uint32_t Color = (Mode == BGM_WHITE ? 0xFFFFFFFF : (Mode == BGM_GREENKEY ? 0xFF00FE00 : 0xFF000000));
+			for (int i = 0; i != Width; i++) m_pBackground[i] = Color;
+		}
+		return m_pBackground;
+	}
+
+	void LoadBackgroundImage()
+	{
+		//Read the bitmap file (of any bit depth Windows supports) as 32 bit bottom-up BGRA pixels, same orientation as the RGB output
+		m_BackgroundImageLoaded = true;
+		char Path[MAX_PATH], *PathFile;
+		DWORD PathLen = GetModuleFileNameA(g_hInst, Path, MAX_PATH);
+		if (!PathLen || PathLen >= MAX_PATH || !(PathFile = strrchr(Path, '\\')) || (PathFile - Path) + sizeof("\\UnityCaptureBackground.bmp") > MAX_PATH) return;
+		strcpy_s(PathFile, MAX_PATH - (PathFile - Path), "\\UnityCaptureBackground.bmp");
+		HBITMAP hBitmap = (HBITMAP)LoadImageA(NULL, Path, IMAGE_BITMAP, 0, 0, LR_LOADFROMFILE | LR_CREATEDIBSECTION);
+		if (!hBitmap) { DebugLog("[CCaptureStream] Background image %s could not be loaded\n", Path); return; }
+		BITMAP bm;
+		if (GetObject(hBitmap, sizeof(bm), &bm) && bm.bmWidth > 0 && bm.bmHeight > 0 && bm.bmWidth <= 8192 && bm.bmHeight <= 8192)
+		{
+			BITMAPINFO bmi = { sizeof(BITMAPINFOHEADER), bm.bmWidth, bm.bmHeight, 1, 32, BI_RGB };
+			HDC hDC = CreateCompatibleDC(0);
+			m_pBackgroundImage = (uint32_t*)malloc(bm.bmWidth * bm.bmHeight * 4);
+			if (GetDIBits(hDC, hBitmap, 0, bm.bmHeight, m_pBackgroundImage, &bmi, DIB_RGB_COLORS) == bm.bmHeight) m_BackgroundImageWidth = bm.bmWidth, m_BackgroundImageHeight = bm.bmHeight;
+			else { free(m_pBackgroundImage); m_pBackgroundImage = NULL; }
+			DeleteDC(hDC);
+		}
+		DeleteObject(hBitmap);
+	}
+
+	static int GetFormatIndex(const BITMAPINFOHEADER& bmi)
+	{
+		for (int i = 0; i != sizeof(_formats)/sizeof(_formats[0]); i++)
+			if (_formats[i].compression == bmi.biCompression && _formats[i].bits == bmi.biBitCount) return i;
+		return -1;
+	}
+
+	static ProcessJob::EInput GetInputFormat(SharedImageMemory::EFormat Format)
+	{
+		//Linear color space sources need to be converted to sRGB, the 8-bit formats always come with gamma (or sRGB) values
+		switch (Format)
+		{
+			case SharedImageMemory::FORMAT_FP16_GAMMA:        return ProcessJob::IN_RGBA16_GAMMA;
+			case SharedImageMemory::FORMAT_FP16_LINEAR:       return ProcessJob::IN_RGBA16_SRGB;
+			case SharedImageMemory::FORMAT_BGRA8:             return ProcessJob::IN_BGRA8;
+			case SharedImageMemory::FORMAT_RGB10A2_GAMMA:     return ProcessJob::IN_RGB10A2_GAMMA;
+			case SharedImageMemory::FORMAT_RGB10A2_LINEAR:    return ProcessJob::IN_RGB10A2_SRGB;
+			case SharedImageMemory::FORMAT_R11G11B10F_GAMMA:  return ProcessJob::IN_R11G11B10F_GAMMA;
+			case SharedImageMemory::FORMAT_R11G11B10F_LINEAR: return ProcessJob::IN_R11G11B10F_SRGB;
+			case SharedImageMemory::FORMAT_FP32_GAMMA:        return ProcessJob::IN_RGBA32F_GAMMA;
+			case SharedImageMemory::FORMAT_FP32_LINEAR:       return ProcessJob::IN_RGBA32F_SRGB;
+			default:                                          return ProcessJob::IN_RGBA8;
+		}
+	}
+
+	static ProcessJob::EOutput GetOutputFormat(const BITMAPINFOHEADER& bmi)
+	{
+		int FormatIndex = GetFormatIndex(bmi);
+		UCASSERT(FormatIndex >= 0);
+		return _formats[FormatIndex < 0 ? 0 : FormatIndex].output;
+	}
+
+	static BITMAPINFOHEADER* GetBitmapInfo(const AM_MEDIA_TYPE* pmt)
+	{
+		//Media types are FORMAT_VideoInfo or (for the 10 bit formats in the HDR modes) FORMAT_VideoInfo2, both start with the same fields up to AvgTimePerFrame
+		if (!pmt->pbFormat) return NULL;
+		return (pmt->formattype == FORMAT_VideoInfo2 ? &((VIDEOINFOHEADER2*)pmt->pbFormat)->bmiHeader : &((VIDEOINFOHEADER*)pmt->pbFormat)->bmiHeader);
+	}
+
+	static DWORD GetImageSize(const BITMAPINFOHEADER& bmi)
+	{
+		//RGB formats use the DIB size (with rows padded to 4 bytes), YUV formats are tightly packed planes
+		if (bmi.biCompression == BI_RGB) return DIBSIZE(bmi);
+		return (DWORD)ProcessJob::GetOutputSize(GetOutputFormat(bmi), bmi.biWidth, abs(bmi.biHeight));
+	}
+
 	//IUnknown
 	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) override
 	{
@@ -652,19 +823,20 @@ private:
 		if (pAlloc == NULL || pRequest == NULL) return E_POINTER;
 		CAutoLock cAutoLock(m_pFilter->pStateLock());
 		HRESULT hr = NOERROR;
-		VIDEOINFO *pvi = (VIDEOINFO*)m_mt.Format();
-		pRequest->cBuffers = 1;
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(&m_mt);
+		m_Pipeline.Enabled = PipelinedDelivery;
+		pRequest->cBuffers = (m_Pipeline.Enabled ? 3 : 1); //with pipelined delivery one being delivered (or held downstream), one ready and one being filled
 
-		DebugLog("[DecideBufferSize] Request Size: %d - Have Size: %d\n", (int)pvi->bmiHeader.biSizeImage, (int)pRequest->cbBuffer);
-		if (pvi->bmiHeader.biSizeImage > (DWORD)pRequest->cbBuffer)
-			pRequest->cbBuffer = pvi->bmiHeader.biSizeImage;
+		DebugLog("[DecideBufferSize] Request Size: %d - Have Size: %d\n", (int)pbmi->biSizeImage, (int)pRequest->cbBuffer);
+		if (pbmi->biSizeImage > (DWORD)pRequest->cbBuffer)
+			pRequest->cbBuffer = pbmi->biSizeImage;
 
 		ALLOCATOR_PROPERTIES actual;
 		hr = pAlloc->SetProperties(pRequest, &actual);
 		if (FAILED(hr)) DebugLog("[DecideBufferSize] E_SOMETHING\n");
 		if (FAILED(hr)) return hr;
 
-		DebugLog("[DecideBufferSize] Request Size: %d - Actual Size: %d\n", (int)pvi->bmiHeader.biSizeImage, (int)actual.cbBuffer);
+		DebugLog("[DecideBufferSize] Request Size: %d - Actual Size: %d\n", (int)pbmi->biSizeImage, (int)actual.cbBuffer);
 		return (actual.cbBuffer < pRequest->cbBuffer ? E_FAIL : S_OK);
 	}
 
@@ -673,19 +845,23 @@ private:
 		if (pmt == NULL) DebugLog("[SetFormat] E_POINTER\n");
 		if (pmt == NULL) return E_POINTER;
 
-		VIDEOINFO* pvi = (VIDEOINFO*)pmt->pbFormat;
+		VIDEOINFOHEADER* pvi = (VIDEOINFOHEADER*)pmt->pbFormat;
 		if (pvi == NULL) DebugLog("[SetFormat] E_UNEXPECTED (pvi is null)\n");
 		if (pvi == NULL) return E_UNEXPECTED;
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(pmt);
+
+		if (GetFormatIndex(*pbmi) < 0) DebugLog("[SetFormat] E_FAIL (unsupported pixel format)\n");
+		if (GetFormatIndex(*pbmi) < 0) return E_FAIL;
 
-		bool HasStrideBytes = (DIBSIZE(pvi->bmiHeader) != pvi->bmiHeader.biWidth * pvi->bmiHeader.biHeight * pvi->bmiHeader.biBitCount / 8);
+		bool HasStrideBytes = (pbmi->biCompression == BI_RGB && DIBSIZE(*pbmi) != pbmi->biWidth * pbmi->biHeight * pbmi->biBitCount / 8);
 		if (HasStrideBytes) DebugLog("[SetFormat] E_FAIL (has stride bytes)\n");
 		if (HasStrideBytes) return E_FAIL;
 
-		DebugLog("[SetFormat] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZE: %d - SIZE CALC: %d\n", (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame,
-			(int)pvi->bmiHeader.biSizeImage, (int)DIBSIZE(pvi->bmiHeader));
+		DebugLog("[SetFormat] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZE: %d - SIZE CALC: %d\n", (int)pbmi->biWidth, (int)pbmi->biHeight, (int)pbmi->biBitCount, (int)pvi->AvgTimePerFrame,
+			(int)pbmi->biSizeImage, (int)DIBSIZE(*pbmi));
 		m_avgTimePerFrame = pvi->AvgTimePerFrame;
 		m_mt = *pmt;
-		((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biSizeImage = DIBSIZE(((VIDEOINFO*)m_mt.pbFormat)->bmiHeader);
+		GetBitmapInfo(&m_mt)->biSizeImage = GetImageSize(*GetBitmapInfo(&m_mt));
 		return S_OK;
 	}
 
@@ -693,7 +869,7 @@ private:
 	{
 		if (ppmt == NULL) DebugLog("[GetFormat] E_POINTER\n");
 		if (ppmt == NULL) return E_POINTER;
-		DebugLog("[GetFormat] RETURNING WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biWidth, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biHeight, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biBitCount, (int)((VIDEOINFO*)m_mt.Format())->AvgTimePerFrame, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biSizeImage, (int)DIBSIZE(((VIDEOINFO*)m_mt.Format())->bmiHeader));
+		DebugLog("[GetFormat] RETURNING WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)GetBitmapInfo(&m_mt)->biWidth, (int)GetBitmapInfo(&m_mt)->biHeight, (int)GetBitmapInfo(&m_mt)->biBitCount, (int)((VIDEOINFOHEADER*)m_mt.Format())->AvgTimePerFrame, (int)GetBitmapInfo(&m_mt)->biSizeImage, (int)DIBSIZE(*GetBitmapInfo(&m_mt)));
 		*ppmt = CreateMediaType(&m_mt);
 		return S_OK;
 	}
@@ -702,7 +878,7 @@ private:
 	{
 		if (piCount == NULL || piSize == NULL) DebugLog("[GetNumberOfCapabilities] E_POINTER\n");
 		if (piCount == NULL || piSize == NULL) return E_POINTER;
-		*piCount = (sizeof(_media)/sizeof(_media[0])*2); //RGB and RGBA variations
+		*piCount = (sizeof(_media)/sizeof(_media[0])*sizeof(_formats)/sizeof(_formats[0])); //every resolution in every pixel format
 		*piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS);
 		DebugLog("[GetNumberOfCapabilities] Returning Count: %d - Size: %d\n", *piCount, *piSize);
 		return S_OK;
@@ -716,14 +892,15 @@ private:
 		CMediaType mt;
 		HRESULT hr = GetMediaType(iIndex, &mt);
 		if (FAILED(hr)) return hr;
-		VIDEOINFO *pvi = (VIDEOINFO*)mt.Format();
+		VIDEOINFOHEADER *pvi = (VIDEOINFOHEADER*)mt.Format();
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(&mt);
 
 		*ppmt = CreateMediaType(&mt);
 
 		VIDEO_STREAM_CONFIG_CAPS* pCaps = (VIDEO_STREAM_CONFIG_CAPS*)pSCC;
 		ZeroMemory(pCaps, sizeof(VIDEO_STREAM_CONFIG_CAPS));
 
-		pCaps->guid = FORMAT_VideoInfo;
+		pCaps->guid = *mt.FormatType();
 		pCaps->VideoStandard      = 0;
 		pCaps->CropAlignX         = 1;
 		pCaps->CropAlignY         = 1;
@@ -733,31 +910,32 @@ private:
 		pCaps->StretchTapsY       = 2;
 		pCaps->ShrinkTapsX        = 2;
 		pCaps->ShrinkTapsY        = 2;
-		pCaps->InputSize.cx       = pvi->bmiHeader.biWidth;
-		pCaps->InputSize.cy       = pvi->bmiHeader.biHeight;
+		pCaps->InputSize.cx       = pbmi->biWidth;
+		pCaps->InputSize.cy       = pbmi->biHeight;
 		pCaps->MinCroppingSize.cx = 1;
 		pCaps->MinCroppingSize.cy = 1;
-		pCaps->MaxCroppingSize.cx = pvi->bmiHeader.biWidth;
-		pCaps->MaxCroppingSize.cy = pvi->bmiHeader.biHeight;
+		pCaps->MaxCroppingSize.cx = pbmi->biWidth;
+		pCaps->MaxCroppingSize.cy = pbmi->biHeight;
 		pCaps->CropGranularityX   = 1;
 		pCaps->CropGranularityY   = 1;
 		pCaps->MinOutputSize.cx   = 4;
 		pCaps->MinOutputSize.cy   = 4;
-		pCaps->MaxOutputSize.cx   = pvi->bmiHeader.biWidth;
-		pCaps->MaxOutputSize.cy   = pvi->bmiHeader.biHeight;
+		pCaps->MaxOutputSize.cx   = pbmi->biWidth;
+		pCaps->MaxOutputSize.cy   = pbmi->biHeight;
 		pCaps->MinFrameInterval = 10000000 / 120;
 		pCaps->MaxFrameInterval = 10000000 / 30;
-		pCaps->MinBitsPerSecond = pCaps->MinOutputSize.cx * pCaps->MinOutputSize.cy * pvi->bmiHeader.biBitCount * 30;
-		pCaps->MaxBitsPerSecond = pCaps->MaxOutputSize.cx * pCaps->MaxOutputSize.cy * pvi->bmiHeader.biBitCount * 120;
-		DebugLog("[GetStreamCaps] Index: %d - MINWIDTH: %d - MINHEIGHT: %d - MAXWIDTH: %d - MAXHEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", iIndex, (int)pCaps->MinOutputSize.cx, (int)pCaps->MinOutputSize.cy, (int)pCaps->MaxOutputSize.cx, (int)pCaps->MaxOutputSize.cy, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame, (int)pvi->bmiHeader.biSizeImage, (int)DIBSIZE(pvi->bmiHeader));
+		pCaps->MinBitsPerSecond = pCaps->MinOutputSize.cx * pCaps->MinOutputSize.cy * pbmi->biBitCount * 30;
+		pCaps->MaxBitsPerSecond = pCaps->MaxOutputSize.cx * pCaps->MaxOutputSize.cy * pbmi->biBitCount * 120;
+		DebugLog("[GetStreamCaps] Index: %d - MINWIDTH: %d - MINHEIGHT: %d - MAXWIDTH: %d - MAXHEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", iIndex, (int)pCaps->MinOutputSize.cx, (int)pCaps->MinOutputSize.cy, (int)pCaps->MaxOutputSize.cx, (int)pCaps->MaxOutputSize.cy, (int)pbmi->biBitCount, (int)pvi->AvgTimePerFrame, (int)pbmi->biSizeImage, (int)DIBSIZE(*pbmi));
 		return S_OK;
 	}
 
 	HRESULT SetMediaType(const CMediaType *pmt) override
 	{
 		VIDEOINFOHEADER* pvi = (VIDEOINFOHEADER*)(pmt->Format());
-		DebugLog("[SetMediaType] [ASKD] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame, (int)pvi->bmiHeader.biSizeImage, (int)DIBSIZE(pvi->bmiHeader));
-		DebugLog("[SetMediaType] [HAVE] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biWidth, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biHeight, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biBitCount, (int)((VIDEOINFO*)m_mt.Format())->AvgTimePerFrame, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biSizeImage, (int)DIBSIZE(((VIDEOINFO*)m_mt.Format())->bmiHeader));
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(pmt);
+		DebugLog("[SetMediaType] [ASKD] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)pbmi->biWidth, (int)pbmi->biHeight, (int)pbmi->biBitCount, (int)pvi->AvgTimePerFrame, (int)pbmi->biSizeImage, (int)DIBSIZE(*pbmi));
+		DebugLog("[SetMediaType] [HAVE] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d\n", (int)GetBitmapInfo(&m_mt)->biWidth, (int)GetBitmapInfo(&m_mt)->biHeight, (int)GetBitmapInfo(&m_mt)->biBitCount, (int)((VIDEOINFOHEADER*)m_mt.Format())->AvgTimePerFrame, (int)GetBitmapInfo(&m_mt)->biSizeImage, (int)DIBSIZE(*GetBitmapInfo(&m_mt)));
 		HRESULT hr = CSourceStream::SetMediaType(pmt);
 		return hr;
 	}
@@ -766,9 +944,10 @@ private:
 	{
 		CAutoLock lock(m_pFilter->pStateLock());
 		VIDEOINFOHEADER *pvi = (VIDEOINFOHEADER *)(pMediaType->Format());
+		const BITMAPINFOHEADER* pbmi = GetBitmapInfo(pMediaType);
 		if (!pvi) DebugLog("[CheckMediaType] WANT VIDEO INFO NULL\n");
-		else DebugLog("[CheckMediaType] [WANT] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d - CBFORMAT: %d\n", (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame, (int)pvi->bmiHeader.biSizeImage, (int)DIBSIZE(pvi->bmiHeader), (int)pMediaType->cbFormat);
-		     DebugLog("[CheckMediaType] [HAVE] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d - CBFORMAT: %d\n", (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biWidth, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biHeight, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biBitCount, (int)((VIDEOINFO*)m_mt.Format())->AvgTimePerFrame, (int)((VIDEOINFO*)m_mt.Format())->bmiHeader.biSizeImage, (int)DIBSIZE(((VIDEOINFO*)m_mt.Format())->bmiHeader), (int)m_mt.cbFormat);
+		else DebugLog("[CheckMediaType] [WANT] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d - CBFORMAT: %d\n", (int)pbmi->biWidth, (int)pbmi->biHeight, (int)pbmi->biBitCount, (int)pvi->AvgTimePerFrame, (int)pbmi->biSizeImage, (int)DIBSIZE(*pbmi), (int)pMediaType->cbFormat);
+		     DebugLog("[CheckMediaType] [HAVE] WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d - SIZEIMAGE: %d - SIZECALC: %d - CBFORMAT: %d\n", (int)GetBitmapInfo(&m_mt)->biWidth, (int)GetBitmapInfo(&m_mt)->biHeight, (int)GetBitmapInfo(&m_mt)->biBitCount, (int)((VIDEOINFOHEADER*)m_mt.Format())->AvgTimePerFrame, (int)GetBitmapInfo(&m_mt)->biSizeImage, (int)DIBSIZE(*GetBitmapInfo(&m_mt)), (int)m_mt.cbFormat);
 		     DebugLog("[CheckMediaType] [RETURNING] %s\n", (*pMediaType != m_mt ? "E_INVALIDARG" : "S_OK"));
 		return (*pMediaType != m_mt ? E_INVALIDARG : S_OK);
 	}
@@ -777,33 +956,89 @@ private:
 	{
 		CheckPointer(pMediaType, E_POINTER);
 		if (iPos < 0) return E_INVALIDARG;
-		if (iPos >= (sizeof(_media)/sizeof(_media[0])*2)) return VFW_S_NO_MORE_ITEMS;
+		if (iPos >= (sizeof(_media)/sizeof(_media[0])*sizeof(_formats)/sizeof(_formats[0]))) return VFW_S_NO_MORE_ITEMS;
 		CAutoLock cAutoLock(m_pFilter->pStateLock()); 
 
-		int iMedia = iPos%(sizeof(_media)/sizeof(_media[0]));
+		int iMedia = iPos%(sizeof(_media)/sizeof(_media[0])), iFormat = iPos/(sizeof(_media)/sizeof(_media[0]));
 		UCASSERT(_media[iMedia].width * _media[iMedia].height * 4 * sizeof(short) <= MAX_SHARED_IMAGE_SIZE);
-		VIDEOINFO *pvi = (VIDEOINFO *)pMediaType->AllocFormatBuffer(sizeof(VIDEOINFO));
-		ZeroMemory(pvi, sizeof(VIDEOINFO));
+		//The 10 bit formats tell the receiver about the BT.2020 primaries and the PQ or HLG curve if one of the HDR modes is selected
+		const EYUVColorSpace ycs = YUVColorSpace;
+		const bool HDR = (_formats[iFormat].output >= ProcessJob::OUT_P010 && (ycs == YCS_BT2100_PQ || ycs == YCS_BT2100_HLG));
+		const ULONG FormatSize = (ULONG)(HDR ? sizeof(VIDEOINFOHEADER2) : sizeof(VIDEOINFO));
+		VIDEOINFOHEADER *pvi = (VIDEOINFOHEADER *)pMediaType->AllocFormatBuffer(FormatSize);
+		ZeroMemory(pvi, FormatSize);
 		pvi->AvgTimePerFrame = m_avgTimePerFrame;
-		BITMAPINFOHEADER *pBmi = &(pvi->bmiHeader);
+		if (HDR) ((VIDEOINFOHEADER2*)pvi)->dwControlFlags = GetHDRControlFlags(ycs);
+		pMediaType->SetFormatType(HDR ? &FORMAT_VideoInfo2 : &FORMAT_VideoInfo);
+		BITMAPINFOHEADER *pBmi = GetBitmapInfo(pMediaType);
 		pBmi->biSize = sizeof(BITMAPINFOHEADER);
-		pBmi->biWidth  = (_media[iMedia].width  ? _media[iMedia].width  : ((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biWidth );
-		pBmi->biHeight = (_media[iMedia].height ? _media[iMedia].height : ((VIDEOINFO*)m_mt.pbFormat)->bmiHeader.biHeight);
+		pBmi->biWidth  = (_media[iMedia].width  ? _media[iMedia].width  : GetBitmapInfo(&m_mt)->biWidth );
+		pBmi->biHeight = (_media[iMedia].height ? _media[iMedia].height : GetBitmapInfo(&m_mt)->biHeight);
 		pBmi->biPlanes = 1;
-		pBmi->biBitCount = (iPos >= (sizeof(_media)/sizeof(_media[0])) ? 32 : 24);
-		pBmi->biCompression = BI_RGB;
-		pvi->bmiHeader.biSizeImage = DIBSIZE(pvi->bmiHeader);
+		pBmi->biBitCount = _formats[iFormat].bits;
+		pBmi->biCompression = _formats[iFormat].compression;
+		pBmi->biSizeImage = GetImageSize(*pBmi);
+		if (HDR) ((VIDEOINFOHEADER2*)pvi)->dwPictAspectRatioX = pBmi->biWidth, ((VIDEOINFOHEADER2*)pvi)->dwPictAspectRatioY = abs(pBmi->biHeight); //square pixels
 
-		//DebugLog("[GetMediaType] iPos: %d - WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d\n", iPos, (int)pvi->bmiHeader.biWidth, (int)pvi->bmiHeader.biHeight, (int)pvi->bmiHeader.biBitCount, (int)pvi->AvgTimePerFrame);
+		//DebugLog("[GetMediaType] iPos: %d - WIDTH: %d - HEIGHT: %d - BITS: %d - TPS: %d\n", iPos, (int)pBmi->biWidth, (int)pBmi->biHeight, (int)pBmi->biBitCount, (int)pvi->AvgTimePerFrame);
 
 		pMediaType->SetType(&MEDIATYPE_Video);
-		pMediaType->SetFormatType(&FORMAT_VideoInfo);
-		pMediaType->SetSubtype(&(pBmi->biBitCount == 32 ? MEDIASUBTYPE_ARGB32 : MEDIASUBTYPE_RGB24));
-		pMediaType->SetSampleSize(pvi->bmiHeader.biSizeImage);
+		pMediaType->SetSubtype(_formats[iFormat].subtype);
+		pMediaType->SetSampleSize(pBmi->biSizeImage);
 		pMediaType->SetTemporalCompression(FALSE);
 		return S_OK;
 	}
 
+	HRESULT DoBufferProcessingLoop() override
+	{
+		//With pipelined delivery a separate thread receives and converts the next frame while this one delivers the last one downstream,
+		//so the frame rate is limited by the slower of the two instead of by their sum (at the cost of a frame of latency when delivering is slower)
+		//Otherwise the same as CSourceStream::DoBufferProcessingLoop (which gets used without pipelining)
+		if (!m_Pipeline.Enabled) return CSourceStream::DoBufferProcessingLoop();
+		Command com;
+		OnThreadStartPlay();
+		StartPipeline();
+		do
+		{
+			while (!CheckRequest(&com))
+			{
+				IMediaSample* pSample;
+				HRESULT hr;
+				{
+					std::lock_guard<std::mutex> Lock(m_Pipeline.Mutex);
+					if ((pSample = m_Pipeline.Ready) != NULL) hr = m_Pipeline.ReadyResult, m_Pipeline.Ready = NULL;
+				}
+				if (!pSample)
+				{
+					//Wait for the next ready sample or a command (like stop), whichever comes first
+					HANDLE Handles[] = { GetRequestHandle(), m_Pipeline.ReadyEvent };
+					WaitForMultipleObjects(2, Handles, FALSE, INFINITE);
+					continue;
+				}
+				m_Pipeline.Condition.notify_all();
+				if (hr == S_OK)
+				{
+					hr = Deliver(pSample);
+					pSample->Release();
+					if (hr != S_OK) { DebugLog("[DoBufferProcessingLoop] Deliver() returned %08x; stopping\n", (int)hr); StopPipeline(); return S_OK; }
+				}
+				else
+				{
+					pSample->Release();
+					StopPipeline();
+					DeliverEndOfStream();
+					if (hr == S_FALSE) return S_OK;
+					m_pFilter->NotifyEvent(EC_ERRORABORT, hr, 0);
+					return hr;
+				}
+			}
+			if (com == CMD_RUN || com == CMD_PAUSE) Reply(NOERROR);
+			else if (com != CMD_STOP) Reply((DWORD)E_UNEXPECTED);
+		} while (com != CMD_STOP);
+		StopPipeline();
+		return S_FALSE;
+	}
+
 	HRESULT OnThreadStartPlay() override
 	{
 		DebugLog("[OnThreadStartPlay] OnThreadStartPlay\n");
@@ -818,9 +1053,17 @@ private:
 	REFERENCE_TIME m_avgTimePerFrame;
 	SharedImageMemory* m_pReceiver;
 	ProcessWorkers m_ProcessWorkers;
-	DWORD m_iUnscaledBufSize;
-	uint8_t *m_pUnscaledBuf, *m_RGBA16Table;
-	SharedImageMemory::EFormat m_RGBA16TableFormat;
+	ResizeCoeffs m_ResizeCoeffs;
+	DirtyTileState m_DirtyTiles;
+	LastFrameState m_LastFrame;
+	ErrorPatternState m_ErrorPattern;
+	PipelineState m_Pipeline;
+	uint8_t *m_pScratchBuf;
+	size_t m_ScratchBufSize;
+	uint32_t *m_pBackground, *m_pBackgroundImage;
+	EBackgroundMode m_BackgroundMode;
+	int m_BackgroundWidth, m_BackgroundHeight, m_BackgroundImageWidth, m_BackgroundImageHeight;
+	bool m_BackgroundImageLoaded;
 
 	//IAMStreamControl
 	HRESULT STDMETHODCALLTYPE StartAt(const REFERENCE_TIME *ptStart, DWORD dwCookie) override { return NOERROR; }
@@ -848,7 +1091,18 @@ public:
 	}
 
 private:
-	CCaptureProperties(LPUNKNOWN lpunk, HRESULT *phr) : CBasePropertyPage("", lpunk, -1, -1) { }
+	CCaptureProperties(LPUNKNOWN lpunk, HRESULT *phr) : CBasePropertyPage("", lpunk, -1, -1), m_CapNum(0) { }
+
+	int m_CapNum; //capture device of the filter the page is shown for (for the settings that are per device)
+
+	HRESULT OnConnect(IUnknown *pUnknown) override
+	{
+		ICamSource* pCamSource;
+		if (FAILED(pUnknown->QueryInterface(IID_ICamSource, (void**)&pCamSource))) return S_OK;
+		m_CapNum = pCamSource->GetCapNum();
+		pCamSource->Release();
+		return S_OK;
+	}
 
 	STDMETHODIMP Activate(HWND hwndParent, LPCRECT prect, BOOL fModal) 
 	{
@@ -866,7 +1120,7 @@ private:
 				#pragma pack(2)
 				WORD FFFF, ClassID; wchar_t Text[2]; WORD NoData;
 				#pragma pack(4)
-			} Items[8];
+			} Items[20];
 			#pragma pack(4)
 		} md = {
 			{ WS_CHILD | WS_VISIBLE | DS_CENTER, NULL, sizeof(md.Items)/sizeof(MyData::Item) }, 0, 0, L"", {
@@ -878,6 +1132,18 @@ private:
 			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90, 53,  150, 100, 1005 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
 			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5, 72,   80,  10, 1006 }, 0xFFFF, 0x0082, L"-" }, //Label
 			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90, 71,  150,  10, 1007 }, 0xFFFF, 0x0080, L"-" }, //Check Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5, 90,   80,  10, 1010 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90, 89,  150, 100, 1011 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,108,   80,  10, 1012 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,107,  150, 100, 1013 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,126,   80,  10, 1014 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90,125,  150,  10, 1015 }, 0xFFFF, 0x0080, L"-" }, //Check Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,144,   80,  10, 1016 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | CBS_DROPDOWNLIST, NULL , 90,143,  150, 100, 1017 }, 0xFFFF, 0x0085, L"-" }, //Combo Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,162,   80,  10, 1018 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | WS_TABSTOP | BS_CHECKBOX,      NULL , 90,161,  150,  10, 1019 }, 0xFFFF, 0x0080, L"-" }, //Check Box
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL ,  5,180,   80,  10, 1008 }, 0xFFFF, 0x0082, L"-" }, //Label
+			{ { WS_VISIBLE | WS_CHILD | SS_LEFT,                       NULL , 90,180,  150,  10, 1009 }, 0xFFFF, 0x0082, L"-" }, //Label
 		}};
 
 		HWND hwnd = CreateDialogIndirectParamW(NULL, &md.Header, hwndParent, &MyDialogProc, (LPARAM)this);
@@ -886,6 +1152,15 @@ private:
 		SetDlgItemTextW(hwnd, 1004, L"Unity sending stopped:");
 		SetDlgItemTextW(hwnd, 1006, L"Display FPS:");
 		SetDlgItemTextW(hwnd, 1007, L"Show capture frame rate");
+		SetDlgItemTextW(hwnd, 1010, L"YUV color space:");
+		SetDlgItemTextW(hwnd, 1012, L"RGB background:");
+		SetDlgItemTextW(hwnd, 1014, L"Skip unchanged:");
+		SetDlgItemTextW(hwnd, 1015, L"Only convert changed tiles");
+		SetDlgItemTextW(hwnd, 1016, L"Conversion threads:");
+		SetDlgItemTextW(hwnd, 1018, L"Pipelined delivery:");
+		SetDlgItemTextW(hwnd, 1019, L"Overlap conversion and delivery");
+		SetDlgItemTextW(hwnd, 1008, L"Pixel conversion:");
+		SetDlgItemTextA(hwnd, 1009, SIMDLevelNames[SIMDLevel]);
 		for (int i = 0; i < 3; i++)
 		{
 			HWND hWndComboBox = GetDlgItem(hwnd, 1001 + i*2);
@@ -894,6 +1169,22 @@ private:
 			SendMessageA(hWndComboBox, CB_SETCURSEL, (WPARAM)ErrorDrawModes[i], (LPARAM)0);
 		}
 		SendMessage(GetDlgItem(hwnd, 1007), BM_SETCHECK, (OutputFrameRate ? BST_CHECKED : BST_UNCHECKED), 0);
+		SendMessage(GetDlgItem(hwnd, 1015), BM_SETCHECK, (DirtyTiles ? BST_CHECKED : BST_UNCHECKED), 0);
+		SendMessage(GetDlgItem(hwnd, 1019), BM_SETCHECK, (PipelinedDelivery ? BST_CHECKED : BST_UNCHECKED), 0);
+		for (int j = 0; j < sizeof(YUVColorSpaceNames)/sizeof(YUVColorSpaceNames[0]); j++)
+			SendMessageW(GetDlgItem(hwnd, 1011), (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)YUVColorSpaceNames[j]);
+		SendMessageA(GetDlgItem(hwnd, 1011), CB_SETCURSEL, (WPARAM)YUVColorSpace, (LPARAM)0);
+		for (int j = 0; j < sizeof(BackgroundModeNames)/sizeof(BackgroundModeNames[0]); j++)
+			SendMessageW(GetDlgItem(hwnd, 1013), (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)BackgroundModeNames[j]);
+		SendMessageA(GetDlgItem(hwnd, 1013), CB_SETCURSEL, (WPARAM)BackgroundMode, (LPARAM)0);
+		for (int j = 0, Default = ProcessWorkers::GetDefaultThreadCount(); j <= Default; j++)
+		{
+			wchar_t ThreadCountName[64];
+			if (j) swprintf_s(ThreadCountName, L"%d thread%s", j, (j == 1 ? L"" : L"s"));
+			else swprintf_s(ThreadCountName, L"Automatic (%d threads)", Default);
+			SendMessageW(GetDlgItem(hwnd, 1017), (UINT)CB_ADDSTRING, (WPARAM)0, (LPARAM)ThreadCountName);
+		}
+		SendMessageA(GetDlgItem(hwnd, 1017), CB_SETCURSEL, (WPARAM)WorkerThreadCounts[m_CapNum], (LPARAM)0);
 
 		SetWindowPos(hwnd, NULL, prect->left, prect->top, prect->right-prect->left, prect->bottom-prect->top, 0); //show in tab page
 		return S_OK;
@@ -901,7 +1192,7 @@ private:
 
 	static INT_PTR CALLBACK MyDialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	{
-		if (uMsg == WM_INITDIALOG) return TRUE;
+		if (uMsg == WM_INITDIALOG) { SetWindowLongPtr(hwnd, DWLP_USER, (LONG_PTR)lParam); return TRUE; }
 		if (uMsg == WM_COMMAND)
 		{
 			//DebugLog("[DIALOG] WM_COMMAND - ItemID: %d - SubCommand: %d - Value: %d\n", (int)LOWORD(wParam), (int)HIWORD(wParam), (int)lParam);
@@ -911,7 +1202,12 @@ private:
 			if (ItemID == 1001 && SubCommand == 1) ErrorDrawModes[EDC_ResolutionMismatch]  = (EErrorDrawMode)SelectionIndex;
 			if (ItemID == 1003 && SubCommand == 1) ErrorDrawModes[EDC_UnityNeverStarted]   = (EErrorDrawMode)SelectionIndex;
 			if (ItemID == 1005 && SubCommand == 1) ErrorDrawModes[EDC_UnitySendingStopped] = (EErrorDrawMode)SelectionIndex;
+			if (ItemID == 1011 && SubCommand == 1) YUVColorSpace = (EYUVColorSpace)SelectionIndex;
+			if (ItemID == 1013 && SubCommand == 1) BackgroundMode = (EBackgroundMode)SelectionIndex;
+			if (ItemID == 1017 && SubCommand == 1) WorkerThreadCounts[((CCaptureProperties*)GetWindowLongPtr(hwnd, DWLP_USER))->m_CapNum] = SelectionIndex;
 			if (ItemID == 1007) SendMessage(hWndItem, BM_SETCHECK, ((OutputFrameRate ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
+			if (ItemID == 1015) SendMessage(hWndItem, BM_SETCHECK, ((DirtyTiles ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
+			if (ItemID == 1019) SendMessage(hWndItem, BM_SETCHECK, ((PipelinedDelivery ^= 1) ? BST_CHECKED : BST_UNCHECKED), 0);
 			return TRUE;
 		}
 		return FALSE;
@@ -922,7 +1218,7 @@ private:
 		pPageInfo->pszTitle = (WCHAR*)CoTaskMemAlloc(sizeof(CaptureSourceName));
 		memcpy(pPageInfo->pszTitle, CaptureSourceName, sizeof(CaptureSourceName));
 		pPageInfo->size.cx      = 490;
-		pPageInfo->size.cy      = 200;
+		pPageInfo->size.cy      = 340;
 		pPageInfo->pszDocString = NULL;
 		pPageInfo->pszHelpFile  = NULL;
 		pPageInfo->dwHelpContext= 0;
@@ -938,7 +1234,7 @@ public:
 		UCASSERT(phr);
 		*phr = S_OK;
 
-		CCaptureSource *pSource = new CCaptureSource(lpunk, phr);
+		CCaptureSource *pSource = new CCaptureSource(lpunk, phr, CapNum);
 		if (FAILED(*phr) || !pSource)
 		{
 			if (!pSource) *phr = E_OUTOFMEMORY;
@@ -961,7 +1257,12 @@ public:
 private:
 	DECLARE_IUNKNOWN;
 
-	CCaptureSource(LPUNKNOWN lpunk, HRESULT* phr) : CSource("Source", lpunk, CLSID_UnityCaptureService, phr) { }
+	CCaptureSource(LPUNKNOWN lpunk, HRESULT* phr, int32_t CapNum) : CSource("Source", lpunk, CLSID_UnityCaptureService, phr), m_CapNum(CapNum) { }
+
+	int32_t m_CapNum;
+
+	//ICamSource
+	STDMETHODIMP_(int) GetCapNum() override { return m_CapNum; }
 
 	//CSource
 	STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void ** ppv) override
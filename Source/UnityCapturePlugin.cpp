@@ -74,9 +74,10 @@ struct UnityCaptureInstance
 	// DirectX12 stuff
 	// TODO
 
-	bool UseDoubleBuffering, AlternativeBuffer, IsLinearColorSpace;
+	bool UseDoubleBuffering, AlternativeBuffer, IsLinearColorSpace, CollectStats;
 	SharedImageMemory::EResizeMode ResizeMode;
 	SharedImageMemory::EMirrorMode MirrorMode;
+	SharedImageMemory::EAlphaMode AlphaMode;
 	int Timeout;
 
 	// Screenshot stuff
@@ -129,8 +130,14 @@ extern "C" __declspec(dllexport) void CaptureDeleteInstance(UnityCaptureInstance
 	delete c;
 }
 
-extern "C" __declspec(dllexport) void SetTextureFromUnity(UnityCaptureInstance* c, void* textureHandle, int Timeout, bool UseDoubleBuffering, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, bool IsLinearColorSpace, int width, int height)
+extern "C" __declspec(dllexport) void SetTextureFromUnity(UnityCaptureInstance* c, void* textureHandle, int Timeout, bool UseDoubleBuffering, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, SharedImageMemory::EAlphaMode AlphaMode, bool CollectStats, bool IsLinearColorSpace, int width, int height)
 {
+	//Settings that are only passed on with every sent frame can change at any time without setting up the texture again
+	c->MirrorMode = MirrorMode;
+	c->AlphaMode = AlphaMode;
+	c->CollectStats = CollectStats;
+	c->ResizeMode = ResizeMode;
+	c->Timeout = Timeout;
 	if (!g_captureInstance || c->Width != width || c->Height != height || c->UseDoubleBuffering != UseDoubleBuffering || c->TextureHandle != textureHandle)
 	{
 		c->Width = width;
@@ -138,9 +145,6 @@ extern "C" __declspec(dllexport) void SetTextureFromUnity(UnityCaptureInstance*
 		c->TextureHandle = textureHandle;
 		c->UseDoubleBuffering = UseDoubleBuffering;
 		c->IsLinearColorSpace = IsLinearColorSpace;
-		c->MirrorMode = MirrorMode;
-		c->ResizeMode = ResizeMode;
-		c->Timeout = Timeout;
 		if (g_GraphicsDeviceType == kUnityGfxRendererD3D11)
 		{
 			c->ctx = NULL;
@@ -173,6 +177,28 @@ extern "C" __declspec(dllexport) void SetTextureFromUnity(UnityCaptureInstance*
 			{
 				c->EFormat = (IsLinearColorSpace ? SharedImageMemory::FORMAT_FP16_LINEAR : SharedImageMemory::FORMAT_FP16_GAMMA);
 			}
+			else if (desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM || desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB || desc.Format == DXGI_FORMAT_B8G8R8A8_TYPELESS)
+			{
+				c->EFormat = SharedImageMemory::FORMAT_BGRA8;
+			}
+			else if (desc.Format == DXGI_FORMAT_R10G10B10A2_UNORM || desc.Format == DXGI_FORMAT_R10G10B10A2_TYPELESS)
+			{
+				c->EFormat = (IsLinearColorSpace ? SharedImageMemory::FORMAT_RGB10A2_LINEAR : SharedImageMemory::FORMAT_RGB10A2_GAMMA);
+			}
+			else if (desc.Format == DXGI_FORMAT_R11G11B10_FLOAT)
+			{
+				c->EFormat = (IsLinearColorSpace ? SharedImageMemory::FORMAT_R11G11B10F_LINEAR : SharedImageMemory::FORMAT_R11G11B10F_GAMMA);
+			}
+			else if (desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT || desc.Format == DXGI_FORMAT_R32G32B32A32_TYPELESS)
+			{
+				c->EFormat = (IsLinearColorSpace ? SharedImageMemory::FORMAT_FP32_LINEAR : SharedImageMemory::FORMAT_FP32_GAMMA);
+			}
+			else
+			{
+				c->lastResult = RET_ERROR_TEXTUREFORMAT;
+				c->TextureHandle = NULL; // Try again with the next call
+				return;
+			}
 			textureDesc.SampleDesc.Count = 1;
 			textureDesc.SampleDesc.Quality = 0;
 			textureDesc.Usage = D3D11_USAGE_STAGING;
@@ -200,15 +226,21 @@ extern "C" __declspec(dllexport) void SetTextureFromUnity(UnityCaptureInstance*
 	}
 }
 
-extern "C" __declspec(dllexport) void PrepareScreenshot(UnityCaptureInstance* c, void* textureHandle, int Timeout, bool UseDoubleBuffering, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, bool IsLinearColorSpace, int width, int height, const wchar_t* fileName)
+extern "C" __declspec(dllexport) void PrepareScreenshot(UnityCaptureInstance* c, void* textureHandle, int Timeout, bool UseDoubleBuffering, SharedImageMemory::EResizeMode ResizeMode, SharedImageMemory::EMirrorMode MirrorMode, SharedImageMemory::EAlphaMode AlphaMode, bool CollectStats, bool IsLinearColorSpace, int width, int height, const wchar_t* fileName)
 {
-	SetTextureFromUnity(c, textureHandle, Timeout, UseDoubleBuffering, ResizeMode, MirrorMode, IsLinearColorSpace, width, height);
+	SetTextureFromUnity(c, textureHandle, Timeout, UseDoubleBuffering, ResizeMode, MirrorMode, AlphaMode, CollectStats, IsLinearColorSpace, width, height);
 	if (g_captureInstance)
 	{
 		g_captureInstance->ss_fileName = fileName;
 	}
 }
 
+extern "C" __declspec(dllexport) bool CaptureGetFrameStats(UnityCaptureInstance* c, SharedImageMemory::FrameStats* stats)
+{
+	//Statistics of the last frame output by the capture device (collected while CollectStats is set), false if there are none yet
+	return (c && c->Sender && c->Sender->GetStats(stats));
+}
+
 extern "C" __declspec(dllexport) int GetLastResult()
 {
 	return g_captureInstance->lastResult;
@@ -312,7 +344,7 @@ static void UNITY_INTERFACE_API OnRenderEvent_D3D11(int eventID)
 
 	//memcpy(m_pSharedBuf->data, buffer, DataSize);
 	//Push the captured data to the direct show filter
-	SharedImageMemory::ESendResult res = g_captureInstance->Sender->Send(desc.Width, desc.Height, mapResource.RowPitch / (g_captureInstance->EFormat == SharedImageMemory::FORMAT_UINT8 ? 4 : 8), mapResource.RowPitch * desc.Height, g_captureInstance->EFormat, g_captureInstance->ResizeMode, g_captureInstance->MirrorMode, g_captureInstance->Timeout, (const unsigned char*)mapResource.pData);
+	SharedImageMemory::ESendResult res = g_captureInstance->Sender->Send(desc.Width, desc.Height, mapResource.RowPitch / SharedImageMemory::GetBytesPerPixel(g_captureInstance->EFormat), mapResource.RowPitch * desc.Height, g_captureInstance->EFormat, g_captureInstance->ResizeMode, g_captureInstance->MirrorMode, g_captureInstance->AlphaMode, g_captureInstance->CollectStats, g_captureInstance->Timeout, (const unsigned char*)mapResource.pData);
 
 	g_captureInstance->ctx->Unmap(ReadTexture, 0);
 
@@ -393,7 +425,7 @@ static void UNITY_INTERFACE_API OnRenderEvent_OpenGL(int eventID)
 	SharedImageMemory::ESendResult res = g_captureInstance->Sender->Send(g_captureInstance->Width, g_captureInstance->Height,
 		g_captureInstance->Width,
 		rowPitch * g_captureInstance->Height, g_captureInstance->EFormat, g_captureInstance->ResizeMode,
-		g_captureInstance->MirrorMode, g_captureInstance->Timeout, (const unsigned char*)g_captureInstance->cachedData_DIRECTSHOW);
+		g_captureInstance->MirrorMode, g_captureInstance->AlphaMode, g_captureInstance->CollectStats, g_captureInstance->Timeout, (const unsigned char*)g_captureInstance->cachedData_DIRECTSHOW);
 
 	switch (res)
 	{
@@ -465,8 +497,8 @@ static void WriteToPNG(void* data, SharedImageMemory::EFormat format, int dataRo
 		return;
 	}
 
-	int bit_depth = format == SharedImageMemory::FORMAT_UINT8 ? 8 : 16;
-	int transform = PNG_TRANSFORM_IDENTITY;
+	int bit_depth = format == SharedImageMemory::FORMAT_UINT8 || format == SharedImageMemory::FORMAT_BGRA8 ? 8 : 16;
+	int transform = format == SharedImageMemory::FORMAT_BGRA8 ? PNG_TRANSFORM_BGR : PNG_TRANSFORM_IDENTITY;
 
 
 
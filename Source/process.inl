@@ -0,0 +1,2121 @@
+/*
+  Unity Capture
+  Copyright (c) 2018 Bernhard Schelling
+
+  Based on UnityCam
+  https://github.com/mrayy/UnityCam
+  Copyright (c) 2016 MHD Yamen Saraiji
+*/
+
+//Pixel format conversion and scaling kernels used by the capture filter (and the benchmark) and the worker threads that run them
+//Besides how worker threads go to sleep this has no dependencies on Windows so it can also be built with GCC/Clang on other platforms
+//Expects shared.inl to be included first for StreamingCopy (which also builds on other platforms)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PROCESS_TARGET_SSSE3
+#define PROCESS_TARGET_AVX2
+#define PROCESS_CAS_POINTER(Dest, Exchange, Comparand) _InterlockedCompareExchangePointer((void* volatile*)(Dest), (Exchange), (Comparand))
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#include <algorithm>
+using std::max;
+using std::min;
+#define __forceinline inline __attribute__((always_inline))
+#define PROCESS_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define PROCESS_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#define PROCESS_CAS_POINTER(Dest, Exchange, Comparand) __sync_val_compare_and_swap((Dest), (Comparand), (Exchange))
+#endif
+#ifndef UCASSERT
+#define UCASSERT(cond) ((void)0)
+#endif
+
+//Instruction set used by the pixel conversion kernels, detected once at load time
+enum ESIMDLevel { SIMD_NONE, SIMD_SSSE3, SIMD_AVX2 };
+static const char* SIMDLevelNames[] = { "Scalar", "SSSE3", "AVX2" };
+static ESIMDLevel DetectSIMDLevel()
+{
+	#ifdef _MSC_VER
+	#define PROCESS_CPUID(Info, Leaf) __cpuidex(Info, Leaf, 0)
+	#define PROCESS_XCR0() _xgetbv(0)
+	#else
+	#define PROCESS_CPUID(Info, Leaf) __cpuid_count(Leaf, 0, Info[0], Info[1], Info[2], Info[3])
+	#define PROCESS_XCR0() __extension__ ({ unsigned int a, d; __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0)); a; })
+	#endif
+	int Info[4];
+	PROCESS_CPUID(Info, 0);
+	const int MaxLeaf = Info[0];
+	if (MaxLeaf < 1) return SIMD_NONE;
+	PROCESS_CPUID(Info, 1);
+	if (!(Info[2] & (1 << 9))) return SIMD_NONE; //no SSSE3
+	const bool HasAVX = ((Info[2] & (1 << 27)) && (Info[2] & (1 << 28)) && (PROCESS_XCR0() & 6) == 6); //OSXSAVE, AVX and OS saves YMM state
+	const bool HasF16C = ((Info[2] & (1 << 29)) != 0); //the AVX2 kernels also use F16C for half float conversion
+	if (!HasAVX || !HasF16C || MaxLeaf < 7) return SIMD_SSSE3;
+	PROCESS_CPUID(Info, 7);
+	return ((Info[1] & (1 << 5)) ? SIMD_AVX2 : SIMD_SSSE3);
+	#undef PROCESS_CPUID
+	#undef PROCESS_XCR0
+}
+static ESIMDLevel SIMDLevel = DetectSIMDLevel();
+
+//Piecewise linear approximation of the linear to sRGB curve (pre-scaled to 0..255.9999) used by the vectorized FP16 kernels
+//The range 2^-13 to 1 is split into 104 segments (8 per power of two) which are indexed by the float exponent and top 3 mantissa bits
+static struct SRGBSegmentTable
+{
+	enum { COUNT = 104, MIN_BITS = (127 - 13) << 23 };
+	float Bias[COUNT], Scale[COUNT];
+	SRGBSegmentTable()
+	{
+		for (int i = 0; i != COUNT; i++)
+		{
+			uint32_t Bits0 = MIN_BITS + (i << 20), Bits1 = Bits0 + (1 << 20);
+			float x0, x1;
+			memcpy(&x0, &Bits0, 4);
+			memcpy(&x1, &Bits1, 4);
+			float y0 = (x0 <= 0.0031308f ? (x0 * 12.92f) : (powf(x0, 1.0f / 2.4f) * 1.055f - 0.055f)) * 255.9999f;
+			float y1 = (x1 <= 0.0031308f ? (x1 * 12.92f) : (powf(x1, 1.0f / 2.4f) * 1.055f - 0.055f)) * 255.9999f;
+			Scale[i] = (y1 - y0) / (x1 - x0);
+			Bias[i] = y0 - Scale[i] * x0;
+		}
+	}
+} SRGBSegments;
+
+//Reciprocals of the alpha values for turning premultiplied colors back into straight colors without a division per pixel
+//An entry is 255 * 256 / alpha (rounded) so a color c becomes the high 16 bits of (c * 256) * Recip[alpha] (with rounding)
+//The extra entry at the end keeps the 4 byte reads of the AVX2 gathers inside the table
+static struct UnpremultiplyTable
+{
+	uint16_t Recip[257];
+	UnpremultiplyTable() { Recip[0] = Recip[256] = 0; for (int a = 1; a != 256; a++) Recip[a] = (uint16_t)((255 * 256 * 2 + a) / (a * 2)); }
+} Unpremultiply;
+
+struct ResizeCoeffs
+{
+	//Separable filter tables for scaling a SrcW x SrcH image into the letterboxed image area of a DstW x DstH frame
+	//Every output column/row uses the same number of taps starting at a clamped source position with 14 bit fixed-point weights
+	//The tables only get rebuilt when the sizes or the resize mode change
+	enum { WEIGHT_BITS = 14 };
+	enum EFilter { FILTER_LINEAR = 1, FILTER_AREA = 2, FILTER_LANCZOS = 3 }; //same values as SharedImageMemory::EResizeMode
+	int SrcW, SrcH, DstW, DstH, Mode, ImgX, ImgY, ImgW, ImgH, TapsX, TapsY;
+	int *StartX, *StartY;
+	int16_t *WeightsX, *WeightsY;
+
+	ResizeCoeffs() { memset(this, 0, sizeof(*this)); }
+	~ResizeCoeffs() { free(StartX); free(StartY); free(WeightsX); free(WeightsY); }
+
+	void Update(int InW, int InH, int OutW, int OutH, int ResizeMode)
+	{
+		if (SrcW == InW && SrcH == InH && DstW == OutW && DstH == OutH && Mode == ResizeMode) return;
+		SrcW = InW, SrcH = InH, DstW = OutW, DstH = OutH, Mode = ResizeMode;
+		const double Scale = max((double)InW / OutW, (double)InH / OutH);
+		ImgW = min(OutW, max(1, (int)(InW / Scale + 0.5))), ImgX = (OutW - ImgW) / 2;
+		ImgH = min(OutH, max(1, (int)(InH / Scale + 0.5))), ImgY = (OutH - ImgH) / 2;
+		TapsX = BuildAxis(InW, ImgW, ResizeMode, &StartX, &WeightsX);
+		TapsY = BuildAxis(InH, ImgH, ResizeMode, &StartY, &WeightsY);
+	}
+
+	static double Sinc(double x) { x *= 3.14159265358979323846; return (x ? sin(x) / x : 1.0); }
+
+	static int BuildAxis(int Src, int Dst, int ResizeMode, int** pStart, int16_t** pWeights)
+	{
+		//Box/area averaging covers exactly the source pixel area of an output pixel and is only used for downscaling
+		//Bilinear and Lanczos-3 kernels get stretched by the downscale factor to filter out frequencies that would alias
+		const double Scale = (double)Src / Dst, FilterScale = (Scale > 1.0 ? Scale : 1.0);
+		const bool Area = (ResizeMode == FILTER_AREA && Scale > 1.0), Lanczos = (ResizeMode == FILTER_LANCZOS);
+		const double Support = (Area ? 0.5 : (Lanczos ? 3.0 : 1.0)) * FilterScale;
+		const int Taps = min(Src, (int)ceil(Support * 2.0) + 1);
+		int *Start = *pStart = (int*)realloc(*pStart, Dst * sizeof(int));
+		int16_t *Weights = *pWeights = (int16_t*)realloc(*pWeights, Dst * Taps * sizeof(int16_t));
+		double* w = (double*)malloc(Taps * sizeof(double));
+		for (int i = 0; i != Dst; i++, Weights += Taps)
+		{
+			const double Center = (i + 0.5) * Scale;
+			//Area covers every source pixel its box overlaps, the other kernels every pixel center inside their support
+			const int First = max(0, (int)floor(Center - Support + (Area ? 0.0 : 0.5))), Last = min(min(Src, (int)(Area ? ceil(Center + Support) : floor(Center + Support + 0.5))), First + Taps);
+			double Sum = 0;
+			for (int j = First; j < Last; j++)
+			{
+				const double x = (j + 0.5 - Center) / FilterScale;
+				if (Area) w[j - First] = max(0.0, min(j + 1.0, Center + Scale * 0.5) - max((double)j, Center - Scale * 0.5));
+				else if (Lanczos) w[j - First] = (x > -3.0 && x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0);
+				else w[j - First] = max(0.0, 1.0 - fabs(x));
+				Sum += w[j - First];
+			}
+
+			//Shift the window left at the right edge so all taps are inside the source, the weights moved along with it
+			Start[i] = min(First, Src - Taps);
+			memset(Weights, 0, Taps * sizeof(int16_t));
+			int Total = 0, Biggest = First - Start[i];
+			for (int j = First; j < Last && Sum > 0; j++)
+			{
+				int16_t& Weight = Weights[j - Start[i]];
+				Total += (Weight = (int16_t)floor(w[j - First] / Sum * (1 << WEIGHT_BITS) + 0.5));
+				if (Weight > Weights[Biggest]) Biggest = j - Start[i];
+			}
+			Weights[Biggest] += (int16_t)((1 << WEIGHT_BITS) - Total); //make the weights sum up to exactly 1.0
+		}
+		free(w);
+		return Taps;
+	}
+};
+
+struct YUVCoeffs
+{
+	//Fixed-point BT.601/BT.709/BT.2020 RGB to YCbCr conversion with coefficients in BGRA order (twice, to multiply-add 2 pixels at once)
+	//Luma uses 14 fractional bits, chroma is computed from the sum of 4 pixels (2x2 or 2x1 doubled) and so uses 16 bits for the average
+	//For 10 bit output (Deep) the inputs are 12 bit values and the shifts are 2 bits larger (16 for luma, 18 for chroma)
+	enum EMatrix { MATRIX_BT601, MATRIX_BT709, MATRIX_BT2020 };
+	int16_t Y[8], U[8], V[8];
+	int32_t YOffset, UVOffset;
+
+	void Set(EMatrix Matrix, bool FullRange, bool Deep = false)
+	{
+		const double Kr = (Matrix == MATRIX_BT2020 ? 0.2627 : (Matrix == MATRIX_BT709 ? 0.2126 : 0.299)), Kb = (Matrix == MATRIX_BT2020 ? 0.0593 : (Matrix == MATRIX_BT709 ? 0.0722 : 0.114));
+		const int Shift = (Deep ? 16 : 14), Max = (Deep ? 1023 : 255), InMax = (Deep ? 4095 : 255);
+		const double YScale = (FullRange ? Max : (Deep ? 876 : 219)) * (double)(1 << Shift) / InMax, CScale = (FullRange ? Max : (Deep ? 896 : 224)) * (double)(1 << Shift) / InMax;
+		const int16_t yr = (int16_t)floor(Kr * YScale + 0.5), yb = (int16_t)floor(Kb * YScale + 0.5), yg = (int16_t)((int)floor(YScale + 0.5) - yr - yb);
+		const int16_t ub = (int16_t)floor(CScale * 0.5 + 0.5), ur = (int16_t)floor(-CScale * 0.5 * Kr / (1.0 - Kb) + 0.5), ug = (int16_t)(-ub - ur); //grey maps to exactly the center
+		const int16_t vr = ub, vb = (int16_t)floor(-CScale * 0.5 * Kb / (1.0 - Kr) + 0.5), vg = (int16_t)(-vr - vb);
+		for (int i = 0; i != 8; i += 4)
+		{
+			Y[i] = yb; Y[i+1] = yg; Y[i+2] = yr; Y[i+3] = 0;
+			U[i] = ub; U[i+1] = ug; U[i+2] = ur; U[i+3] = 0;
+			V[i] = vb; V[i+1] = vg; V[i+2] = vr; V[i+3] = 0;
+		}
+		YOffset = ((FullRange ? 0 : (Deep ? 64 : 16)) << Shift) + (1 << (Shift - 1));
+		UVOffset = ((Deep ? 512 : 128) << (Shift + 2)) + (1 << (Shift + 1));
+	}
+};
+
+struct ProcessStats
+{
+	//Luma histogram and sums of the output pixels of a frame (or of the rows one worker thread converted), luma is BT.709 weighted 8 bit RGB (before any YUV conversion)
+	//Alpha gets counted only for BGRA output, rows get added by the kernels right after producing them while they are still in the cache
+	//There are 4 interleaved histograms so runs of the same luma (like a black frame) don't serialize on incrementing a single counter
+	uint32_t Bins[4][256];
+	uint64_t Pixels, LumaSum, AlphaSum, TransparentPixels, OpaquePixels;
+
+	void Clear() { memset(this, 0, sizeof(*this)); }
+
+	void Add(const ProcessStats& o)
+	{
+		for (int i = 0; i != 4 * 256; i++) Bins[i / 256][i % 256] += o.Bins[i / 256][i % 256];
+		Pixels += o.Pixels, LumaSum += o.LumaSum, AlphaSum += o.AlphaSum, TransparentPixels += o.TransparentPixels, OpaquePixels += o.OpaquePixels;
+	}
+
+	void GetHistogram(uint32_t* Histogram) const { for (int i = 0; i != 256; i++) Histogram[i] = Bins[0][i] + Bins[1][i] + Bins[2][i] + Bins[3][i]; }
+
+	template <int BPP, bool Alpha> void AddRow(const uint8_t* p, size_t n)
+	{
+		//Luma (and alpha) of 4 pixels at a time in 32 bit lanes, the sums stay in registers for the row and only the histogram is in memory
+		//BGR pixels get loaded as 32 bit values (with the blue of the following pixel as the ignored 4th byte, so one more pixel is needed)
+		const __m128i Zero = _mm_setzero_si128(), Max = _mm_set1_epi32(255);
+		__m128i Sum = Zero, ASum = Zero, Clear = Zero, Full = Zero;
+		uint32_t l[4];
+		size_t i = 0;
+		for (; i + 4 + (BPP == 3) <= n; i += 4, p += BPP * 4)
+		{
+			__m128i px;
+			if (BPP == 4) px = _mm_loadu_si128((const __m128i*)p);
+			else { uint32_t v[4]; for (int k = 0; k != 4; k++) memcpy(v + k, p + k * 3, 4); px = _mm_loadu_si128((const __m128i*)v); }
+			const __m128i Luma = LumaOf4(_mm_unpacklo_epi8(px, Zero), _mm_unpackhi_epi8(px, Zero), 8);
+			_mm_storeu_si128((__m128i*)l, Luma);
+			Bins[0][l[0]]++, Bins[1][l[1]]++, Bins[2][l[2]]++, Bins[3][l[3]]++;
+			Sum = _mm_add_epi32(Sum, Luma);
+			if (!Alpha) continue;
+			const __m128i a = _mm_srli_epi32(px, 24);
+			ASum = _mm_add_epi32(ASum, a), Clear = _mm_sub_epi32(Clear, _mm_cmpeq_epi32(a, Zero)), Full = _mm_sub_epi32(Full, _mm_cmpeq_epi32(a, Max));
+		}
+		uint64_t Rest = 0, ARest = 0, ClearRest = 0, FullRest = 0;
+		for (; i != n; i++, p += BPP)
+		{
+			const unsigned Luma = (p[0] * 19 + p[1] * 183 + p[2] * 54 + 128) >> 8;
+			Bins[0][Luma]++, Rest += Luma;
+			if (Alpha) ARest += p[3], ClearRest += (p[3] == 0), FullRest += (p[3] == 255);
+		}
+		Pixels += n, LumaSum += LaneSum(Sum) + Rest;
+		if (Alpha) AlphaSum += LaneSum(ASum) + ARest, TransparentPixels += LaneSum(Clear) + ClearRest, OpaquePixels += LaneSum(Full) + FullRest;
+	}
+
+	void AddRowDeep(const uint16_t* p, size_t n)
+	{
+		//12 bit BGRA rows of the 10 bit outputs (which have no alpha)
+		__m128i Sum = _mm_setzero_si128();
+		uint32_t l[4];
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4, p += 16)
+		{
+			const __m128i Luma = LumaOf4(_mm_loadu_si128((const __m128i*)p), _mm_loadu_si128((const __m128i*)(p + 8)), 12);
+			_mm_storeu_si128((__m128i*)l, Luma);
+			Bins[0][l[0]]++, Bins[1][l[1]]++, Bins[2][l[2]]++, Bins[3][l[3]]++;
+			Sum = _mm_add_epi32(Sum, Luma);
+		}
+		uint64_t Rest = 0;
+		for (; i != n; i++, p += 4) { const unsigned Luma = (p[0] * 19 + p[1] * 183 + p[2] * 54 + 2048) >> 12; Bins[0][Luma]++, Rest += Luma; }
+		Pixels += n, LumaSum += LaneSum(Sum) + Rest;
+	}
+
+	static __forceinline __m128i LumaOf4(__m128i Lo, __m128i Hi, int Shift)
+	{
+		//Takes 16 bit BGRA channels of 2+2 pixels (like PairsToY), the weights sum up to 256 so 8 bit input gives 8 bit luma with a shift of 8
+		const __m128i Weights = _mm_setr_epi16(19, 183, 54, 0, 19, 183, 54, 0);
+		__m128 a = _mm_castsi128_ps(_mm_madd_epi16(Lo, Weights)), b = _mm_castsi128_ps(_mm_madd_epi16(Hi, Weights));
+		__m128i Sum = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+		return _mm_srl_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(1 << (Shift - 1))), _mm_cvtsi32_si128(Shift));
+	}
+
+	static uint64_t LaneSum(__m128i v) { uint32_t l[4]; _mm_storeu_si128((__m128i*)l, v); return (uint64_t)l[0] + l[1] + l[2] + l[3]; }
+
+	void AddBlack(size_t n, bool Alpha) { Bins[0][0] += (uint32_t)n, Pixels += n; if (Alpha) TransparentPixels += n; } //cleared borders
+};
+
+struct ProcessScratch
+{
+	//Temporary row buffers of the kernels which only grow, so a thread that keeps one (like the threads of ProcessWorkers) doesn't allocate per job
+	void* Buf; size_t Size;
+
+	ProcessScratch() : Buf(NULL), Size(0) {}
+	~ProcessScratch() { free(Buf); }
+	void* Get(size_t NeedSize) { if (NeedSize > Size) { free(Buf); Buf = malloc(NeedSize); Size = NeedSize; } return Buf; }
+	void* GetZeroed(size_t NeedSize) { return memset(Get(NeedSize), 0, NeedSize); }
+
+private:
+	ProcessScratch(const ProcessScratch&);
+	ProcessScratch& operator=(const ProcessScratch&);
+};
+
+struct ProcessJob
+{
+	enum EInput { IN_RGBA8, IN_RGBA16_GAMMA, IN_RGBA16_SRGB, IN_BGRA8, IN_RGB10A2_GAMMA, IN_RGB10A2_SRGB, IN_R11G11B10F_GAMMA, IN_R11G11B10F_SRGB, IN_RGBA32F_GAMMA, IN_RGBA32F_SRGB, _IN_COUNT };
+	enum EOutput { OUT_BGR, OUT_BGRA, OUT_NV12, OUT_YUY2, OUT_I420, OUT_P010, OUT_Y210, _OUT_COUNT };
+	enum EAlpha { ALPHA_KEEP, ALPHA_PREMULTIPLY, ALPHA_UNPREMULTIPLY }; //same values as SharedImageMemory::EAlphaMode
+	enum ETransfer { TRANSFER_GAMMA, TRANSFER_SRGB, TRANSFER_PQ, TRANSFER_HLG, _TRANSFER_COUNT }; //curves of the tables for 16 bit float sources
+	enum { TILE_ROWS = 16 }; //rows per tile of the source hashes used to skip unchanged parts of a frame (even so 4:2:0 row pairs are never split)
+	template <int In> struct Input { enum {
+		BPP = (In == IN_RGBA16_GAMMA || In == IN_RGBA16_SRGB ? 8 : (In == IN_RGBA32F_GAMMA || In == IN_RGBA32F_SRGB ? 16 : 4)), R = (In == IN_BGRA8 ? 2 : 0), B = (In == IN_BGRA8 ? 0 : 2),
+		U8 = (In == IN_RGBA8 || In == IN_BGRA8), HALF = (In == IN_RGBA16_GAMMA || In == IN_RGBA16_SRGB), SRGB = (In == IN_RGBA16_SRGB || In == IN_RGB10A2_SRGB || In == IN_R11G11B10F_SRGB || In == IN_RGBA32F_SRGB) }; };
+	template <int Out> struct Output { enum { BPP = (Out == OUT_BGRA ? 4 : 3), YUV = (Out >= OUT_NV12), DEEP = (Out == OUT_P010 || Out == OUT_Y210), CHROMA_ROWS = (Out == OUT_YUY2 || Out == OUT_Y210 ? 1 : 2) }; };
+	typedef void (ProcessJob::*KernelFunc)();
+	typedef void (*RowFunc)(const void*, uint8_t*, size_t, const uint8_t*);
+	typedef void (*DeepRowFunc)(const void*, uint16_t*, size_t, const uint16_t*);
+	KernelFunc Kernel;
+	const void *BufIn; void *BufOut;
+	size_t Width, Height, RowStart, RowEnd, RGBAInStride;
+	const uint8_t* RGBA16Table;
+	const uint16_t* RGBA16Table12;
+	bool WideGamut; //16 bit float sources get converted from BT.709 to BT.2020 primaries (in linear light) before the 12 bit table for the HDR curves
+	const ResizeCoeffs* Coeffs;
+	YUVCoeffs YUV;
+	bool FlipSource; //resize and downscale kernels read the source rows in reverse (vertical flip)
+	const uint32_t* Background; size_t BackgroundPitch; //BGR output gets blended over these BGRA pixels if set, a pitch of 0 repeats one row of a solid color
+	EAlpha AlphaMode; //changes the alpha representation of BGRA output, blending over a background takes unpremultiply to mean a premultiplied source
+	bool StreamOut; //BGR(A) output rows get written with non-temporal stores, for frames that are too large to stay in the cache anyway
+	ProcessStats* Stats; //if set, statistics of the output pixels of the job get added to it (each worker thread has its own)
+	ProcessScratch* Scratch; //set by Execute
+
+	inline void Execute(ProcessScratch* ThreadScratch = NULL)
+	{
+		UCASSERT(RowEnd >= RowStart);
+		if (RowStart == RowEnd) return;
+		ProcessScratch Own; //only allocates anything if no scratch buffer of the thread is passed
+		Scratch = (ThreadScratch ? ThreadScratch : &Own);
+		(this->*Kernel)();
+		Scratch = NULL;
+		if (StreamOut) _mm_sfence(); //make the non-temporal stores visible before the output gets handed on
+	}
+
+	static KernelFunc GetConvertKernel(EInput In, EOutput Out, bool Mirror, bool VFlip)
+	{
+		//Every combination of input format, output format, horizontal mirroring and vertical flipping is its own specialized single pass kernel
+		#define CONVERT_KERNELS(In, Out) { { &ProcessJob::Convert<In, Out, false, false>, &ProcessJob::Convert<In, Out, false, true> }, { &ProcessJob::Convert<In, Out, true, false>, &ProcessJob::Convert<In, Out, true, true> } }
+		#define CONVERT_KERNELS_OUT(In) { CONVERT_KERNELS(In, OUT_BGR), CONVERT_KERNELS(In, OUT_BGRA), CONVERT_KERNELS(In, OUT_NV12), CONVERT_KERNELS(In, OUT_YUY2), CONVERT_KERNELS(In, OUT_I420), CONVERT_KERNELS(In, OUT_P010), CONVERT_KERNELS(In, OUT_Y210) }
+		static const KernelFunc Kernels[_IN_COUNT][_OUT_COUNT][2][2] = { CONVERT_KERNELS_OUT(IN_RGBA8), CONVERT_KERNELS_OUT(IN_RGBA16_GAMMA), CONVERT_KERNELS_OUT(IN_RGBA16_SRGB), CONVERT_KERNELS_OUT(IN_BGRA8),
+			CONVERT_KERNELS_OUT(IN_RGB10A2_GAMMA), CONVERT_KERNELS_OUT(IN_RGB10A2_SRGB), CONVERT_KERNELS_OUT(IN_R11G11B10F_GAMMA), CONVERT_KERNELS_OUT(IN_R11G11B10F_SRGB), CONVERT_KERNELS_OUT(IN_RGBA32F_GAMMA), CONVERT_KERNELS_OUT(IN_RGBA32F_SRGB) };
+		#undef CONVERT_KERNELS_OUT
+		#undef CONVERT_KERNELS
+		return Kernels[In][Out][Mirror][VFlip];
+	}
+
+	static KernelFunc GetResizeKernel(EInput In, EOutput Out, bool Mirror)
+	{
+		#define RESIZE_KERNELS(In, Out) { &ProcessJob::Resize<In, Out, false>, &ProcessJob::Resize<In, Out, true> }
+		#define RESIZE_KERNELS_OUT(In) { RESIZE_KERNELS(In, OUT_BGR), RESIZE_KERNELS(In, OUT_BGRA), RESIZE_KERNELS(In, OUT_NV12), RESIZE_KERNELS(In, OUT_YUY2), RESIZE_KERNELS(In, OUT_I420), RESIZE_KERNELS(In, OUT_P010), RESIZE_KERNELS(In, OUT_Y210) }
+		static const KernelFunc Kernels[_IN_COUNT][_OUT_COUNT][2] = { RESIZE_KERNELS_OUT(IN_RGBA8), RESIZE_KERNELS_OUT(IN_RGBA16_GAMMA), RESIZE_KERNELS_OUT(IN_RGBA16_SRGB), RESIZE_KERNELS_OUT(IN_BGRA8),
+			RESIZE_KERNELS_OUT(IN_RGB10A2_GAMMA), RESIZE_KERNELS_OUT(IN_RGB10A2_SRGB), RESIZE_KERNELS_OUT(IN_R11G11B10F_GAMMA), RESIZE_KERNELS_OUT(IN_R11G11B10F_SRGB), RESIZE_KERNELS_OUT(IN_RGBA32F_GAMMA), RESIZE_KERNELS_OUT(IN_RGBA32F_SRGB) };
+		#undef RESIZE_KERNELS_OUT
+		#undef RESIZE_KERNELS
+		return Kernels[In][Out][Mirror];
+	}
+
+	static KernelFunc GetDownscaleKernel(EInput In, EOutput Out, bool Mirror, int Factor)
+	{
+		#define DOWNSCALE_KERNELS(In, Out, Mirror) { &ProcessJob::Downscale<In, Out, Mirror, 2>, &ProcessJob::Downscale<In, Out, Mirror, 3>, &ProcessJob::Downscale<In, Out, Mirror, 4> }
+		#define DOWNSCALE_KERNELS_MIRROR(In, Out) { DOWNSCALE_KERNELS(In, Out, false), DOWNSCALE_KERNELS(In, Out, true) }
+		#define DOWNSCALE_KERNELS_OUT(In) { DOWNSCALE_KERNELS_MIRROR(In, OUT_BGR), DOWNSCALE_KERNELS_MIRROR(In, OUT_BGRA), DOWNSCALE_KERNELS_MIRROR(In, OUT_NV12), DOWNSCALE_KERNELS_MIRROR(In, OUT_YUY2), DOWNSCALE_KERNELS_MIRROR(In, OUT_I420), DOWNSCALE_KERNELS_MIRROR(In, OUT_P010), DOWNSCALE_KERNELS_MIRROR(In, OUT_Y210) }
+		static const KernelFunc Kernels[_IN_COUNT][_OUT_COUNT][2][3] = { DOWNSCALE_KERNELS_OUT(IN_RGBA8), DOWNSCALE_KERNELS_OUT(IN_RGBA16_GAMMA), DOWNSCALE_KERNELS_OUT(IN_RGBA16_SRGB), DOWNSCALE_KERNELS_OUT(IN_BGRA8),
+			DOWNSCALE_KERNELS_OUT(IN_RGB10A2_GAMMA), DOWNSCALE_KERNELS_OUT(IN_RGB10A2_SRGB), DOWNSCALE_KERNELS_OUT(IN_R11G11B10F_GAMMA), DOWNSCALE_KERNELS_OUT(IN_R11G11B10F_SRGB), DOWNSCALE_KERNELS_OUT(IN_RGBA32F_GAMMA), DOWNSCALE_KERNELS_OUT(IN_RGBA32F_SRGB) };
+		#undef DOWNSCALE_KERNELS_OUT
+		#undef DOWNSCALE_KERNELS_MIRROR
+		#undef DOWNSCALE_KERNELS
+		UCASSERT(Factor >= 2 && Factor <= 4);
+		return Kernels[In][Out][Mirror][Factor - 2];
+	}
+
+	static KernelFunc GetRotateKernel(EInput In, bool Clockwise)
+	{
+		#define ROTATE_KERNELS(In) { &ProcessJob::Rotate<In, false>, &ProcessJob::Rotate<In, true> }
+		static const KernelFunc Kernels[_IN_COUNT][2] = { ROTATE_KERNELS(IN_RGBA8), ROTATE_KERNELS(IN_RGBA16_GAMMA), ROTATE_KERNELS(IN_RGBA16_SRGB), ROTATE_KERNELS(IN_BGRA8),
+			ROTATE_KERNELS(IN_RGB10A2_GAMMA), ROTATE_KERNELS(IN_RGB10A2_SRGB), ROTATE_KERNELS(IN_R11G11B10F_GAMMA), ROTATE_KERNELS(IN_R11G11B10F_SRGB), ROTATE_KERNELS(IN_RGBA32F_GAMMA), ROTATE_KERNELS(IN_RGBA32F_SRGB) };
+		#undef ROTATE_KERNELS
+		return Kernels[In][Clockwise];
+	}
+
+	static KernelFunc GetRotateRawKernel(bool Clockwise)
+	{
+		return (Clockwise ? &ProcessJob::RotateRaw<true> : &ProcessJob::RotateRaw<false>);
+	}
+
+	static size_t GetOutputSize(EOutput Out, size_t Width, size_t Height)
+	{
+		//YUV formats have 2x2 (4:2:0) or 2x1 (YUY2, Y210) subsampled chroma, odd sizes round the chroma planes up, P010 and Y210 use 16 bit samples
+		const size_t ChromaWidth = (Width + 1) / 2, ChromaHeight = (Height + 1) / 2;
+		if (Out == OUT_NV12 || Out == OUT_I420) return Width * Height + ChromaWidth * ChromaHeight * 2;
+		if (Out == OUT_YUY2) return ChromaWidth * 4 * Height;
+		if (Out == OUT_P010) return (Width * Height + ChromaWidth * ChromaHeight * 2) * 2;
+		if (Out == OUT_Y210) return ChromaWidth * 8 * Height;
+		return Width * Height * (Out == OUT_BGRA ? 4 : 3);
+	}
+
+	template <int In, int OutBPP, bool Mirror> static RowFunc GetConvertRow()
+	{
+		//BGRA8 sources that don't get mirrored already are the output format so the rows only need to be copied
+		if (In == IN_BGRA8 && OutBPP == 4 && !Mirror) return &CopyRow;
+		return (SIMDLevel >= SIMD_AVX2 ? &ConvertRow_AVX2<In, OutBPP, Mirror> : (SIMDLevel >= SIMD_SSSE3 && Input<In>::U8 ? &ConvertRow_SSSE3<In, OutBPP, Mirror> : &ConvertRow_Scalar<In, OutBPP, Mirror>));
+	}
+
+	template <int In, bool Mirror> static DeepRowFunc GetConvertRowDeep(bool WideGamut)
+	{
+		if (WideGamut && Input<In>::HALF) return (SIMDLevel >= SIMD_AVX2 ? &ConvertRowDeep_AVX2<In, Mirror, true> : &ConvertRowDeep_Scalar<In, Mirror, true>);
+		return (SIMDLevel >= SIMD_AVX2 && Input<In>::HALF ? &ConvertRowDeep_AVX2<In, Mirror, false> : &ConvertRowDeep_Scalar<In, Mirror, false>);
+	}
+
+	static const float* GetBT2020Primaries()
+	{
+		//Linear light BT.709 to BT.2020 RGB matrix (BT.2087) in row order, each row sums to 1 so white stays white
+		static const float Matrix[9] = { 0.6274039f, 0.3292830f, 0.0433131f, 0.0690973f, 0.9195404f, 0.0113623f, 0.0163914f, 0.0880133f, 0.8955953f };
+		return Matrix;
+	}
+
+	static float HalfBitsToLinear(uint16_t h)
+	{
+		//Decodes 16 bit float bits like the tables do (negative values become 0, denormals are exact so 0 stays black in PQ)
+		if (h & 0x8000) return 0.0f;
+		if (!(h & 0x7C00)) return h * (1.0f / 16777216.0f);
+		float f;
+		uint32_t Bits = ((uint32_t)h << 13) + 0x38000000;
+		memcpy(&f, &Bits, 4);
+		return f;
+	}
+
+	static uint16_t LinearToHalfBits(float f)
+	{
+		//Rounds a non-negative float to the 16 bit float bits of the table entry closest to it (the inverse of HalfBitsToLinear)
+		if (f < (1.0f / 16384.0f)) return (uint16_t)(int)(f * 16777216.0f + 0.5f); //denormal range
+		int32_t Bits;
+		memcpy(&Bits, &f, 4);
+		Bits = (Bits - (0x38000000 - 0x1000)) >> 13;
+		return (uint16_t)(Bits < 0 ? 0 : (Bits > 0x7FFF ? 0x7FFF : Bits));
+	}
+
+	static float EncodeTransfer(float f, ETransfer Transfer)
+	{
+		//Turn a linear value (with 1.0 being SDR white) into the 0 to 1 signal of a transfer curve, values past 1 saturate in the tables
+		//PQ puts SDR white at 203 nits and HLG at a signal level of 75% as recommended by BT.2408, gamma input is already encoded
+		if (!(f > 0.0f)) return 0.0f;
+		switch (Transfer)
+		{
+			case TRANSFER_SRGB: return (f <= 0.0031308f ? (f * 12.92f) : (powf(f, 1.0f / 2.4f) * 1.055f - 0.055f));
+			case TRANSFER_PQ: { const float y = powf(min(f * (203.0f / 10000.0f), 1.0f), 0.1593017578125f); return powf((0.8359375f + 18.8515625f * y) / (1.0f + 18.6875f * y), 78.84375f); }
+			case TRANSFER_HLG: { const float e = f * 0.26496256f; return (e <= 1.0f / 12.0f ? sqrtf(3.0f * e) : 0.17883277f * logf(12.0f * e - 0.28466892f) + 0.55991073f); }
+			default: return f;
+		}
+	}
+
+	static void BuildRGBA16Table(uint8_t* Table, ETransfer Transfer)
+	{
+		//Map 16 bit floats to 8 bit color values, needed on CPUs without F16C and for the HDR curves
+		//The 3 extra entries at the end keep the 4 byte reads of the AVX2 gathers inside the table
+		for (int i = 0; i <= 0xFFFF; i++)
+		{
+			const float f = EncodeTransfer(HalfBitsToLinear((uint16_t)i), Transfer);
+			Table[i] = (f < 1.0f ? (uint8_t)(f * 255.9999f) : 255);
+		}
+		Table[0x10000] = Table[0x10001] = Table[0x10002] = 0;
+	}
+
+	static void BuildRGBA16Table12(uint16_t* Table, ETransfer Transfer)
+	{
+		//Map 16 bit floats to 12 bit values for the 10 bit YUV outputs, rounded unlike the 8 bit table
+		//The extra entry at the end keeps the 4 byte reads of the AVX2 gathers inside the table
+		for (int i = 0; i <= 0xFFFF; i++)
+		{
+			const float f = EncodeTransfer(HalfBitsToLinear((uint16_t)i), Transfer);
+			Table[i] = (uint16_t)(f < 1.0f ? (int)(f * 4095.0f + 0.5f) : 4095);
+		}
+		Table[0x10000] = 0;
+	}
+
+	static const uint8_t* GetRGBA16Table(ETransfer Transfer) { return (const uint8_t*)GetSharedTable(Transfer, false); }
+	static const uint16_t* GetRGBA16Table12(ETransfer Transfer) { return (const uint16_t*)GetSharedTable(Transfer, true); }
+
+	static const void* GetSharedTable(ETransfer Transfer, bool Table12)
+	{
+		//The tables get built on first use and are then shared by all streams of the process so switching between them costs nothing
+		//When two threads build the same table at once, the one that loses the race to publish it frees its copy
+		static void* volatile Tables[2][_TRANSFER_COUNT];
+		void* volatile* Slot = &Tables[Table12][Transfer];
+		if (!*Slot)
+		{
+			void* New = malloc(Table12 ? (0xFFFF+2) * sizeof(uint16_t) : 0xFFFF+4);
+			if (Table12) BuildRGBA16Table12((uint16_t*)New, Transfer);
+			else BuildRGBA16Table((uint8_t*)New, Transfer);
+			if (PROCESS_CAS_POINTER(Slot, New, (void*)NULL) != NULL) free(New);
+		}
+		return *Slot;
+	}
+
+	template <int In, int Out, bool Mirror, bool VFlip> void Convert()
+	{
+		//Convert RGBA source rows to 8-bit BGR(A) while also eliminating possible row gaps (when stride != width)
+		if (Output<Out>::YUV) { ConvertYUV<In, Out, Mirror, VFlip>(); return; }
+		enum { OutBPP = Output<Out>::BPP };
+		RowFunc ConvertRow = GetConvertRow<In, OutBPP, Mirror>();
+		const size_t InPitch = RGBAInStride * Input<In>::BPP, OutPitch = Width * OutBPP;
+		const uint8_t *src = (const uint8_t*)BufIn + (RowStart * InPitch);
+		if (OutBPP == 3 && Background)
+		{
+			//Blending over a background needs the alpha channel so rows get converted to BGRA first (unless they already are)
+			const RowFunc ConvertRowBGRA = GetConvertRow<In, 4, Mirror>();
+			uint8_t* Row = (In == IN_BGRA8 && !Mirror ? NULL : (uint8_t*)Scratch->Get(Width * 4));
+			for (size_t y = RowStart; y != RowEnd; y++, src += InPitch)
+			{
+				if (Row) ConvertRowBGRA(src, Row, Width, RGBA16Table);
+				StoreComposite((VFlip ? Height - 1 - y : y), (Row ? Row : src));
+			}
+			return;
+		}
+		if (StreamOut)
+		{
+			//Rows get converted into a buffer that stays in the cache and then get streamed out, BGRA8 sources can be streamed directly
+			const bool Direct = (In == IN_BGRA8 && OutBPP == 4 && !Mirror && AlphaMode == ALPHA_KEEP);
+			uint8_t* Row = (Direct ? NULL : (uint8_t*)Scratch->Get(OutPitch));
+			for (size_t y = RowStart; y != RowEnd; y++, src += InPitch)
+			{
+				uint8_t* dst = (uint8_t*)BufOut + ((VFlip ? Height - 1 - y : y) * OutPitch);
+				if (Direct) { if (Stats) Stats->AddRow<4, true>(src, Width); StreamingCopy(dst, src, OutPitch, false); continue; }
+				ConvertRow(src, Row, Width, RGBA16Table);
+				if (OutBPP == 4) ConvertAlphaRow(Row, Width);
+				if (Stats) Stats->AddRow<OutBPP, OutBPP == 4>(Row, Width);
+				StreamingCopy(dst, Row, OutPitch, false);
+			}
+			return;
+		}
+		if (!Mirror && !VFlip && RGBAInStride == Width && (OutBPP == 3 || AlphaMode == ALPHA_KEEP) && !Stats)
+		{
+			//Rows are contiguous and in order so the whole band is one long row (unless collecting statistics which is done row by row)
+			ConvertRow(src, (uint8_t*)BufOut + (RowStart * OutPitch), (RowEnd - RowStart) * Width, RGBA16Table);
+			return;
+		}
+		for (size_t y = RowStart; y != RowEnd; y++, src += InPitch)
+		{
+			uint8_t* dst = (uint8_t*)BufOut + ((VFlip ? Height - 1 - y : y) * OutPitch);
+			ConvertRow(src, dst, Width, RGBA16Table);
+			if (OutBPP == 4) ConvertAlphaRow(dst, Width); //while the row is still in the cache
+			if (Stats) Stats->AddRow<OutBPP, OutBPP == 4>(dst, Width);
+		}
+	}
+
+	void StoreComposite(size_t y, const uint8_t* Row)
+	{
+		//Blend a BGRA output row over the background in pieces that stay in the L1 cache until they get packed to BGR
+		const RowFunc PackRow = GetConvertRow<IN_BGRA8, 3, false>();
+		const uint32_t* bg = Background + y * BackgroundPitch;
+		uint8_t *dst = (uint8_t*)BufOut + y * Width * 3, Blended[256 * 4], Packed[256 * 3];
+		for (size_t x = 0, n; x < Width; x += n)
+		{
+			n = min(Width - x, (size_t)256);
+			if (AlphaMode == ALPHA_UNPREMULTIPLY) (SIMDLevel >= SIMD_AVX2 ? CompositeRow_AVX2<true> : CompositeRow<true>)(Row + x * 4, bg + x, Blended, n);
+			else (SIMDLevel >= SIMD_AVX2 ? CompositeRow_AVX2<false> : CompositeRow<false>)(Row + x * 4, bg + x, Blended, n);
+			if (Stats) Stats->AddRow<4, false>(Blended, n);
+			if (StreamOut) PackRow(Blended, Packed, n, NULL), StreamingCopy(dst + x * 3, Packed, n * 3, false);
+			else PackRow(Blended, dst + x * 3, n, NULL);
+		}
+	}
+
+	template <bool Premultiplied> static void CompositeRow(const uint8_t* src, const uint32_t* bg, uint8_t* dst, size_t n)
+	{
+		//src * a + bg * (255 - a) for 4 pixels per step in 16 bit lanes (the alpha gets spread to all channels of a pixel)
+		//The sum is at most 255 * 255 + 128 so the division by 255 with rounding is exact as (v + (v >> 8)) >> 8 after adding 128
+		//Premultiplied colors are already multiplied so they get scaled by 255 instead (after clamping them to alpha to keep the sum in range)
+		const __m128i Zero = _mm_setzero_si128(), Max = _mm_set1_epi16(255), Round = _mm_set1_epi16(128);
+		for (; n >= 4; n -= 4, src += 16, bg += 4, dst += 16)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)src), back = _mm_loadu_si128((const __m128i*)bg), Res[2];
+			for (int i = 0; i != 2; i++)
+			{
+				__m128i s = (i ? _mm_unpackhi_epi8(px, Zero) : _mm_unpacklo_epi8(px, Zero)), b = (i ? _mm_unpackhi_epi8(back, Zero) : _mm_unpacklo_epi8(back, Zero));
+				__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				if (Premultiplied) s = _mm_min_epi16(s, a);
+				__m128i v = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, (Premultiplied ? Max : a)), _mm_mullo_epi16(b, _mm_sub_epi16(Max, a))), Round);
+				Res[i] = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+			}
+			_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(Res[0], Res[1]));
+		}
+		for (const uint8_t* b = (const uint8_t*)bg; n--; src += 4, b += 4, dst += 4)
+			for (int c = 0; c != 4; c++) { unsigned v = (Premultiplied ? min(src[c], src[3]) * 255 : src[c] * src[3]) + b[c] * (255 - src[3]) + 128; dst[c] = (uint8_t)((v + (v >> 8)) >> 8); }
+	}
+
+	template <bool Premultiplied> PROCESS_TARGET_AVX2 static void CompositeRow_AVX2(const uint8_t* src, const uint32_t* bg, uint8_t* dst, size_t n)
+	{
+		const __m256i Zero = _mm256_setzero_si256(), Max = _mm256_set1_epi16(255), Round = _mm256_set1_epi16(128);
+		const __m256i AlphaShuf = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15, 6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+		for (; n >= 8; n -= 8, src += 32, bg += 8, dst += 32)
+		{
+			__m256i px = _mm256_loadu_si256((const __m256i*)src), back = _mm256_loadu_si256((const __m256i*)bg), Res[2];
+			for (int i = 0; i != 2; i++)
+			{
+				__m256i s = (i ? _mm256_unpackhi_epi8(px, Zero) : _mm256_unpacklo_epi8(px, Zero)), b = (i ? _mm256_unpackhi_epi8(back, Zero) : _mm256_unpacklo_epi8(back, Zero));
+				__m256i a = _mm256_shuffle_epi8(s, AlphaShuf);
+				if (Premultiplied) s = _mm256_min_epi16(s, a);
+				__m256i v = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s, (Premultiplied ? Max : a)), _mm256_mullo_epi16(b, _mm256_sub_epi16(Max, a))), Round);
+				Res[i] = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+			}
+			_mm256_storeu_si256((__m256i*)dst, _mm256_packus_epi16(Res[0], Res[1])); //unpack and pack both work within 128 bit lanes so the order is kept
+		}
+		CompositeRow<Premultiplied>(src, bg, dst, n);
+	}
+
+	void ConvertAlphaRow(uint8_t* p, size_t n)
+	{
+		if (AlphaMode == ALPHA_PREMULTIPLY) (SIMDLevel >= SIMD_AVX2 ? PremultiplyRow_AVX2 : PremultiplyRow)(p, n);
+		else if (AlphaMode == ALPHA_UNPREMULTIPLY) (SIMDLevel >= SIMD_AVX2 ? UnpremultiplyRow_AVX2 : UnpremultiplyRow)(p, n);
+	}
+
+	static void PremultiplyRow(uint8_t* p, size_t n)
+	{
+		//Colors get multiplied by alpha / 255 with the same exact rounding as the blending in CompositeRow, the alpha values are kept
+		const __m128i Zero = _mm_setzero_si128(), Round = _mm_set1_epi16(128), AlphaMask = _mm_set1_epi32((int)0xFF000000);
+		for (; n >= 4; n -= 4, p += 16)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)p), Res[2];
+			for (int i = 0; i != 2; i++)
+			{
+				__m128i s = (i ? _mm_unpackhi_epi8(px, Zero) : _mm_unpacklo_epi8(px, Zero));
+				__m128i v = _mm_add_epi16(_mm_mullo_epi16(s, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3))), Round);
+				Res[i] = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+			}
+			_mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_andnot_si128(AlphaMask, _mm_packus_epi16(Res[0], Res[1])), _mm_and_si128(px, AlphaMask)));
+		}
+		for (; n--; p += 4)
+			for (int c = 0; c != 3; c++) { unsigned v = p[c] * p[3] + 128; p[c] = (uint8_t)((v + (v >> 8)) >> 8); }
+	}
+
+	static void UnpremultiplyRow(uint8_t* p, size_t n)
+	{
+		//Colors (clamped to alpha) get multiplied by the reciprocal of their alpha from the table, as 16 bit values shifted up by 8 bits
+		//The high half of the product is the result, the top bit of the low half rounds it, fully transparent pixels become black
+		const __m128i Zero = _mm_setzero_si128(), AlphaMask = _mm_set1_epi32((int)0xFF000000);
+		const uint16_t* Recip = Unpremultiply.Recip;
+		for (; n >= 4; n -= 4, p += 16)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)p), Res[2];
+			__m128i r = _mm_setr_epi16((short)Recip[p[3]], (short)Recip[p[7]], (short)Recip[p[11]], (short)Recip[p[15]], 0, 0, 0, 0);
+			r = _mm_unpacklo_epi16(r, r);
+			for (int i = 0; i != 2; i++)
+			{
+				__m128i s = (i ? _mm_unpackhi_epi8(px, Zero) : _mm_unpacklo_epi8(px, Zero)), m = (i ? _mm_unpackhi_epi32(r, r) : _mm_unpacklo_epi32(r, r));
+				s = _mm_slli_epi16(_mm_min_epi16(s, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3))), 8);
+				Res[i] = _mm_add_epi16(_mm_mulhi_epu16(s, m), _mm_srli_epi16(_mm_mullo_epi16(s, m), 15));
+			}
+			_mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_andnot_si128(AlphaMask, _mm_packus_epi16(Res[0], Res[1])), _mm_and_si128(px, AlphaMask)));
+		}
+		for (; n--; p += 4)
+			for (int c = 0; c != 3; c++) { unsigned v = (unsigned)(min(p[c], p[3]) << 8) * Recip[p[3]]; p[c] = (uint8_t)min((v >> 16) + ((v >> 15) & 1), 255u); }
+	}
+
+	PROCESS_TARGET_AVX2 static void PremultiplyRow_AVX2(uint8_t* p, size_t n)
+	{
+		const __m256i Zero = _mm256_setzero_si256(), Round = _mm256_set1_epi16(128), AlphaMask = _mm256_set1_epi32((int)0xFF000000);
+		const __m256i AlphaShuf = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15, 6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+		for (; n >= 8; n -= 8, p += 32)
+		{
+			__m256i px = _mm256_loadu_si256((const __m256i*)p), Res[2];
+			for (int i = 0; i != 2; i++)
+			{
+				__m256i s = (i ? _mm256_unpackhi_epi8(px, Zero) : _mm256_unpacklo_epi8(px, Zero));
+				__m256i v = _mm256_add_epi16(_mm256_mullo_epi16(s, _mm256_shuffle_epi8(s, AlphaShuf)), Round);
+				Res[i] = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+			}
+			_mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(_mm256_packus_epi16(Res[0], Res[1]), px, AlphaMask));
+		}
+		PremultiplyRow(p, n);
+	}
+
+	PROCESS_TARGET_AVX2 static void UnpremultiplyRow_AVX2(uint8_t* p, size_t n)
+	{
+		//The reciprocals of 8 pixels get gathered at once and spread to both 16 bit halves, unpacking them then lines them up like the colors
+		const __m256i Zero = _mm256_setzero_si256(), AlphaMask = _mm256_set1_epi32((int)0xFF000000), Low16 = _mm256_set1_epi32(0xFFFF);
+		const __m256i AlphaShuf = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15, 6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+		for (; n >= 8; n -= 8, p += 32)
+		{
+			__m256i px = _mm256_loadu_si256((const __m256i*)p), Res[2];
+			__m256i r = _mm256_and_si256(_mm256_i32gather_epi32((const int*)Unpremultiply.Recip, _mm256_srli_epi32(px, 24), 2), Low16);
+			r = _mm256_or_si256(r, _mm256_slli_epi32(r, 16));
+			for (int i = 0; i != 2; i++)
+			{
+				__m256i s = (i ? _mm256_unpackhi_epi8(px, Zero) : _mm256_unpacklo_epi8(px, Zero)), m = (i ? _mm256_unpackhi_epi32(r, r) : _mm256_unpacklo_epi32(r, r));
+				s = _mm256_slli_epi16(_mm256_min_epi16(s, _mm256_shuffle_epi8(s, AlphaShuf)), 8);
+				Res[i] = _mm256_add_epi16(_mm256_mulhi_epu16(s, m), _mm256_srli_epi16(_mm256_mullo_epi16(s, m), 15));
+			}
+			_mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(_mm256_packus_epi16(Res[0], Res[1]), px, AlphaMask));
+		}
+		UnpremultiplyRow(p, n);
+	}
+
+	template <int In, int Out, bool Mirror, bool VFlip> void ConvertYUV()
+	{
+		//Source rows get converted to BGRA first (unless they already are), then 1 (YUY2) or 2 rows (4:2:0) at a time to YUV
+		//YUV images are stored top-down unlike the bottom-up RGB DIBs so the rows are read in reverse to keep the same orientation
+		//For 10 bit output, FP16 sources are converted to 12 bit rows instead while other sources get expanded from 8 bit when storing
+		enum { Step = Output<Out>::CHROMA_ROWS, Direct = (In == IN_BGRA8 && !Mirror) };
+		if (Output<Out>::DEEP && Input<In>::HALF) { ConvertYUVDeep<In, Out, Mirror, VFlip>(); return; }
+		const RowFunc ConvertRow = GetConvertRow<In, 4, Mirror>();
+		const size_t InPitch = RGBAInStride * Input<In>::BPP;
+		uint8_t* Rows = (Direct ? NULL : (uint8_t*)Scratch->Get(Width * 4 * Step));
+		const uint8_t* Row[2] = { NULL, NULL };
+		for (size_t y = RowStart; y < RowEnd; y += Step)
+		{
+			for (size_t k = 0; k != Step && y + k < Height; k++)
+			{
+				const uint8_t* src = (const uint8_t*)BufIn + (VFlip ? y + k : Height - 1 - (y + k)) * InPitch;
+				if (Direct) { Row[k] = src; continue; }
+				ConvertRow(src, Rows + k * Width * 4, Width, RGBA16Table);
+				Row[k] = Rows + k * Width * 4;
+			}
+			StoreYUV<Out>(y, Row[0], Row[Step - 1]);
+		}
+	}
+
+	template <int In, int Out, bool Mirror, bool VFlip> void ConvertYUVDeep()
+	{
+		enum { Step = Output<Out>::CHROMA_ROWS };
+		const DeepRowFunc ConvertRow = GetConvertRowDeep<In, Mirror>(WideGamut);
+		const size_t InPitch = RGBAInStride * Input<In>::BPP;
+		uint16_t* Rows = (uint16_t*)Scratch->Get(Width * 8 * Step);
+		for (size_t y = RowStart; y < RowEnd; y += Step)
+		{
+			for (size_t k = 0; k != Step && y + k < Height; k++)
+			{
+				ConvertRow((const uint8_t*)BufIn + (VFlip ? y + k : Height - 1 - (y + k)) * InPitch, Rows + k * Width * 4, Width, RGBA16Table12);
+				if (Stats) Stats->AddRowDeep(Rows + k * Width * 4, Width);
+			}
+			StoreYUVDeep<Out>(y, Rows, Rows + (Step - 1) * Width * 4, 0, Width);
+		}
+	}
+
+	template <int Out> void StoreYUV(size_t y, const uint8_t* Row0, const uint8_t* Row1)
+	{
+		//Write one BGRA row (YUY2) or a pair of rows starting at an even row (NV12 with interleaved chroma, I420 with separate U and V planes)
+		//With an odd height the final row is used twice for the chroma of the last pair
+		uint8_t* dst = (uint8_t*)BufOut;
+		if (Stats) { Stats->AddRow<4, false>(Row0, Width); if (Output<Out>::CHROMA_ROWS == 2 && y + 1 < Height) Stats->AddRow<4, false>(Row1, Width); }
+		if (y + 1 >= Height) Row1 = Row0;
+		if (Output<Out>::DEEP)
+		{
+			//8 bit rows get expanded to 12 bit in segments of an even number of pixels for the 10 bit kernels
+			uint16_t Seg[2][256 * 4];
+			for (size_t x = 0, n; x < Width; x += n)
+			{
+				n = min(Width - x, (size_t)256);
+				ExpandBGRA8(Row0 + x * 4, Seg[0], n);
+				if (Row1 != Row0) ExpandBGRA8(Row1 + x * 4, Seg[1], n);
+				StoreYUVDeep<Out>(y, Seg[0], Seg[Row1 != Row0 ? 1 : 0], x, n);
+			}
+			return;
+		}
+		const size_t ChromaWidth = (Width + 1) / 2, ChromaHeight = (Height + 1) / 2;
+		if (Out == OUT_YUY2) { BGRAToYUY2(Row0, dst + y * ChromaWidth * 4, Width, YUV); return; }
+		BGRAToY(Row0, dst + y * Width, Width, YUV);
+		if (y + 1 < Height) BGRAToY(Row1, dst + (y + 1) * Width, Width, YUV);
+		uint8_t* Chroma = dst + Width * Height;
+		if (Out == OUT_NV12) BGRAToUV420(Row0, Row1, Chroma + (y / 2) * ChromaWidth * 2, NULL, Width, YUV);
+		else BGRAToUV420(Row0, Row1, Chroma + (y / 2) * ChromaWidth, Chroma + (ChromaHeight + y / 2) * ChromaWidth, Width, YUV);
+	}
+
+	template <int Out> void StoreYUVDeep(size_t y, const uint16_t* Row0, const uint16_t* Row1, size_t x, size_t n)
+	{
+		//Write the pixels x to x+n (with x even) of one 12 bit BGRA row (Y210) or a row pair (P010 with interleaved chroma)
+		uint16_t* dst = (uint16_t*)BufOut;
+		if (y + 1 >= Height) Row1 = Row0;
+		const size_t ChromaWidth = (Width + 1) / 2;
+		if (Out == OUT_Y210) { BGRA16ToY210(Row0, dst + y * ChromaWidth * 4 + x * 2, n, YUV); return; }
+		BGRA16ToY(Row0, dst + y * Width + x, n, YUV);
+		if (y + 1 < Height) BGRA16ToY(Row1, dst + (y + 1) * Width + x, n, YUV);
+		BGRA16ToUV420(Row0, Row1, dst + Width * Height + (y / 2) * ChromaWidth * 2 + x, n, YUV);
+	}
+
+	template <int Shift> static __forceinline __m128i PairsToY(__m128i Lo, __m128i Hi, const YUVCoeffs& c)
+	{
+		//Takes 16 bit channels of 2+2 pixels, multiply-add gives B*cb+G*cg and R*cr per pixel and the float shuffles gather those halves
+		//for the final add (4 luma values in 32 bit)
+		const __m128i CY = _mm_loadu_si128((const __m128i*)c.Y);
+		__m128 a = _mm_castsi128_ps(_mm_madd_epi16(Lo, CY)), b = _mm_castsi128_ps(_mm_madd_epi16(Hi, CY));
+		__m128i Sum = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+		return _mm_srai_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(c.YOffset)), Shift);
+	}
+
+	static __forceinline __m128i BGRAToY4(__m128i px, const YUVCoeffs& c)
+	{
+		const __m128i Zero = _mm_setzero_si128();
+		return PairsToY<14>(_mm_unpacklo_epi8(px, Zero), _mm_unpackhi_epi8(px, Zero), c);
+	}
+
+	template <int Shift> static __forceinline __m128i BGRASumsToUV(__m128i Lo, __m128i Hi, const YUVCoeffs& c)
+	{
+		//Takes 16 bit channel sums of 4 pixels (each 2 rows or doubled) and returns U0,U1,V0,V1 from the horizontal pairs 0+1 and 2+3
+		__m128i Sums = _mm_add_epi16(_mm_unpacklo_epi64(Lo, Hi), _mm_unpackhi_epi64(Lo, Hi));
+		__m128 u = _mm_castsi128_ps(_mm_madd_epi16(Sums, _mm_loadu_si128((const __m128i*)c.U))), v = _mm_castsi128_ps(_mm_madd_epi16(Sums, _mm_loadu_si128((const __m128i*)c.V)));
+		__m128i UV = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(u, v, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(u, v, _MM_SHUFFLE(3, 1, 3, 1))));
+		return _mm_srai_epi32(_mm_add_epi32(UV, _mm_set1_epi32(c.UVOffset)), Shift);
+	}
+
+	static __forceinline __m128i BGRAToY16(const uint8_t* src, const YUVCoeffs& c)
+	{
+		const __m128i* s = (const __m128i*)src;
+		__m128i y0 = BGRAToY4(_mm_loadu_si128(s + 0), c), y1 = BGRAToY4(_mm_loadu_si128(s + 1), c), y2 = BGRAToY4(_mm_loadu_si128(s + 2), c), y3 = BGRAToY4(_mm_loadu_si128(s + 3), c);
+		return _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+	}
+
+	static __forceinline __m128i InterleaveUV(__m128i a, __m128i b)
+	{
+		//From two vectors of U0,U1,V0,V1 (32 bit) to 8 interleaved U,V byte pairs
+		a = _mm_packs_epi32(a, b);
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+	}
+
+	static void BGRAToY(const uint8_t* src, uint8_t* dst, size_t n, const YUVCoeffs& c)
+	{
+		for (; n >= 16; n -= 16, src += 64, dst += 16) _mm_storeu_si128((__m128i*)dst, BGRAToY16(src, c));
+		if (!n) return;
+		uint8_t TailIn[64], TailOut[16];
+		memcpy(TailIn, src, n * 4);
+		_mm_storeu_si128((__m128i*)TailOut, BGRAToY16(TailIn, c));
+		memcpy(dst, TailOut, n);
+	}
+
+	static void BGRAToUV420(const uint8_t* src0, const uint8_t* src1, uint8_t* dstU, uint8_t* dstV, size_t n, const YUVCoeffs& c)
+	{
+		//Average 2x2 pixel blocks of 16 pixels of 2 rows per step, without dstV the output is interleaved (NV12)
+		const __m128i Zero = _mm_setzero_si128();
+		uint8_t TailIn[2][64], TailU[16], TailV[8];
+		for (size_t Count; n; n -= Count, src0 += 64, src1 += 64)
+		{
+			const uint8_t *s0 = src0, *s1 = src1;
+			uint8_t *u = dstU, *v = dstV;
+			if ((Count = (n < 16 ? n : 16)) != 16)
+			{
+				//The final pixel gets repeated to fill the remaining block (which gives odd widths the right value for the last chroma sample)
+				for (size_t i = 0; i != 16; i++) { memcpy(TailIn[0] + i * 4, src0 + (i < n ? i : n - 1) * 4, 4); memcpy(TailIn[1] + i * 4, src1 + (i < n ? i : n - 1) * 4, 4); }
+				s0 = TailIn[0], s1 = TailIn[1], u = TailU, v = (dstV ? TailV : NULL);
+			}
+			__m128i UV[4];
+			for (int i = 0; i != 4; i++)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)s0 + i), b = _mm_loadu_si128((const __m128i*)s1 + i);
+				UV[i] = BGRASumsToUV<16>(_mm_add_epi16(_mm_unpacklo_epi8(a, Zero), _mm_unpacklo_epi8(b, Zero)), _mm_add_epi16(_mm_unpackhi_epi8(a, Zero), _mm_unpackhi_epi8(b, Zero)), c);
+			}
+			if (!dstV) _mm_storeu_si128((__m128i*)u, _mm_packus_epi16(InterleaveUV(UV[0], UV[1]), InterleaveUV(UV[2], UV[3])));
+			else
+			{
+				__m128i a = _mm_shuffle_epi32(_mm_packs_epi32(UV[0], UV[1]), _MM_SHUFFLE(3, 1, 2, 0)), b = _mm_shuffle_epi32(_mm_packs_epi32(UV[2], UV[3]), _MM_SHUFFLE(3, 1, 2, 0));
+				__m128i Packed = _mm_packus_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+				_mm_storel_epi64((__m128i*)u, Packed);
+				_mm_storel_epi64((__m128i*)v, _mm_srli_si128(Packed, 8));
+			}
+			const size_t ChromaCount = (Count + 1) / 2;
+			if (u == TailU) { memcpy(dstU, TailU, ChromaCount * (dstV ? 1 : 2)); if (dstV) memcpy(dstV, TailV, ChromaCount); }
+			dstU += (dstV ? 8 : 16);
+			if (dstV) dstV += 8;
+		}
+	}
+
+	static void BGRAToYUY2(const uint8_t* src, uint8_t* dst, size_t n, const YUVCoeffs& c)
+	{
+		//16 pixels per step with chroma from horizontal pixel pairs (their sum doubled to match the 4 pixel sums of 4:2:0)
+		const __m128i Zero = _mm_setzero_si128();
+		uint8_t TailIn[64], TailOut[32];
+		for (size_t Count; n; n -= Count, src += 64, dst += 32)
+		{
+			const uint8_t* s = src;
+			uint8_t* d = dst;
+			if ((Count = (n < 16 ? n : 16)) != 16)
+			{
+				for (size_t i = 0; i != 16; i++) memcpy(TailIn + i * 4, src + (i < n ? i : n - 1) * 4, 4);
+				s = TailIn, d = TailOut;
+			}
+			__m128i UV[4];
+			for (int i = 0; i != 4; i++)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)s + i);
+				UV[i] = BGRASumsToUV<16>(_mm_slli_epi16(_mm_unpacklo_epi8(a, Zero), 1), _mm_slli_epi16(_mm_unpackhi_epi8(a, Zero), 1), c);
+			}
+			__m128i Y = BGRAToY16(s, c), Chroma = _mm_packus_epi16(InterleaveUV(UV[0], UV[1]), InterleaveUV(UV[2], UV[3]));
+			_mm_storeu_si128((__m128i*)d + 0, _mm_unpacklo_epi8(Y, Chroma));
+			_mm_storeu_si128((__m128i*)d + 1, _mm_unpackhi_epi8(Y, Chroma));
+			if (d == TailOut) memcpy(dst, TailOut, ((Count + 1) / 2) * 4);
+		}
+	}
+
+	static __forceinline __m128i To10Bit(__m128i Lo, __m128i Hi)
+	{
+		//Pack two vectors of 32 bit values to 16 bit samples with the 10 bit value clamped and placed in the upper bits
+		return _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(Lo, Hi), _mm_setzero_si128()), _mm_set1_epi16(1023)), 6);
+	}
+
+	static void BGRA16ToY(const uint16_t* src, uint16_t* dst, size_t n, const YUVCoeffs& c)
+	{
+		//8 pixels of 12 bit BGRA per step to 10 bit luma
+		uint16_t TailIn[32], TailOut[8];
+		for (size_t Count; n; n -= Count, src += 32, dst += 8)
+		{
+			const uint16_t* s = src;
+			uint16_t* d = dst;
+			if ((Count = (n < 8 ? n : 8)) != 8) { memcpy(TailIn, src, Count * 8); s = TailIn, d = TailOut; }
+			const __m128i* p = (const __m128i*)s;
+			_mm_storeu_si128((__m128i*)d, To10Bit(PairsToY<16>(_mm_loadu_si128(p), _mm_loadu_si128(p + 1), c), PairsToY<16>(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3), c)));
+			if (d == TailOut) memcpy(dst, TailOut, Count * 2);
+		}
+	}
+
+	static void BGRA16ToUV420(const uint16_t* src0, const uint16_t* src1, uint16_t* dst, size_t n, const YUVCoeffs& c)
+	{
+		//Interleaved 10 bit chroma (P010) of 2x2 pixel blocks, 8 pixels of 2 rows per step (the 12 bit sums of 4 pixels fit in 16 bit)
+		uint16_t TailIn[2][32], TailOut[8];
+		for (size_t Count; n; n -= Count, src0 += 32, src1 += 32, dst += 8)
+		{
+			const uint16_t *s0 = src0, *s1 = src1;
+			uint16_t* d = dst;
+			if ((Count = (n < 8 ? n : 8)) != 8)
+			{
+				for (size_t i = 0; i != 8; i++) { memcpy(TailIn[0] + i * 4, src0 + (i < n ? i : n - 1) * 4, 8); memcpy(TailIn[1] + i * 4, src1 + (i < n ? i : n - 1) * 4, 8); }
+				s0 = TailIn[0], s1 = TailIn[1], d = TailOut;
+			}
+			const __m128i *a = (const __m128i*)s0, *b = (const __m128i*)s1;
+			__m128i UV0 = BGRASumsToUV<18>(_mm_add_epi16(_mm_loadu_si128(a + 0), _mm_loadu_si128(b + 0)), _mm_add_epi16(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1)), c);
+			__m128i UV1 = BGRASumsToUV<18>(_mm_add_epi16(_mm_loadu_si128(a + 2), _mm_loadu_si128(b + 2)), _mm_add_epi16(_mm_loadu_si128(a + 3), _mm_loadu_si128(b + 3)), c);
+			_mm_storeu_si128((__m128i*)d, To10Bit(_mm_shuffle_epi32(UV0, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(UV1, _MM_SHUFFLE(3, 1, 2, 0))));
+			if (d == TailOut) memcpy(dst, TailOut, ((Count + 1) / 2) * 4);
+		}
+	}
+
+	static void BGRA16ToY210(const uint16_t* src, uint16_t* dst, size_t n, const YUVCoeffs& c)
+	{
+		//8 pixels of 12 bit BGRA per step to 10 bit Y0 U Y1 V samples with chroma from doubled horizontal pixel pairs like YUY2
+		uint16_t TailIn[32], TailOut[16];
+		for (size_t Count; n; n -= Count, src += 32, dst += 16)
+		{
+			const uint16_t* s = src;
+			uint16_t* d = dst;
+			if ((Count = (n < 8 ? n : 8)) != 8)
+			{
+				for (size_t i = 0; i != 8; i++) memcpy(TailIn + i * 4, src + (i < n ? i : n - 1) * 4, 8);
+				s = TailIn, d = TailOut;
+			}
+			const __m128i* p = (const __m128i*)s;
+			__m128i p0 = _mm_loadu_si128(p), p1 = _mm_loadu_si128(p + 1), p2 = _mm_loadu_si128(p + 2), p3 = _mm_loadu_si128(p + 3);
+			__m128i Y = To10Bit(PairsToY<16>(p0, p1, c), PairsToY<16>(p2, p3, c));
+			__m128i UV0 = BGRASumsToUV<18>(_mm_slli_epi16(p0, 1), _mm_slli_epi16(p1, 1), c), UV1 = BGRASumsToUV<18>(_mm_slli_epi16(p2, 1), _mm_slli_epi16(p3, 1), c);
+			__m128i Chroma = To10Bit(_mm_shuffle_epi32(UV0, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(UV1, _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm_storeu_si128((__m128i*)d + 0, _mm_unpacklo_epi16(Y, Chroma));
+			_mm_storeu_si128((__m128i*)d + 1, _mm_unpackhi_epi16(Y, Chroma));
+			if (d == TailOut) memcpy(dst, TailOut, ((Count + 1) / 2) * 8);
+		}
+	}
+
+	static void ExpandBGRA8(const uint8_t* src, uint16_t* dst, size_t n)
+	{
+		//8 bit to 12 bit values by bit replication (255 becomes 4095), 4 pixels per step
+		const __m128i Zero = _mm_setzero_si128();
+		for (; n >= 4; n -= 4, src += 16, dst += 16)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)src), Lo = _mm_unpacklo_epi8(px, Zero), Hi = _mm_unpackhi_epi8(px, Zero);
+			_mm_storeu_si128((__m128i*)dst + 0, _mm_or_si128(_mm_slli_epi16(Lo, 4), _mm_srli_epi16(Lo, 4)));
+			_mm_storeu_si128((__m128i*)dst + 1, _mm_or_si128(_mm_slli_epi16(Hi, 4), _mm_srli_epi16(Hi, 4)));
+		}
+		for (size_t i = 0; i != n * 4; i++) dst[i] = (uint16_t)((src[i] << 4) | (src[i] >> 4));
+	}
+
+	template <int In, bool Mirror, bool WideGamut> static void ConvertRowDeep_Scalar(const void* src, uint16_t* dst, size_t n, const uint16_t* ttbl)
+	{
+		//FP16 sources go through the 12 bit lookup table, 8 bit sources get expanded by bit replication
+		//With WideGamut the colors get mixed into the BT.2020 primaries first, in the same order of float operations as the AVX2 version
+		const float* m = GetBT2020Primaries();
+		for (size_t i = 0; i != n; i++, dst += 4)
+		{
+			const size_t j = (Mirror ? n - 1 - i : i);
+			if (!Input<In>::HALF)
+			{
+				uint32_t x = FetchBGRA<In>(src, j, NULL);
+				for (int k = 0; k != 4; k++) { uint32_t v = (x >> (k * 8)) & 0xFF; dst[k] = (uint16_t)((v << 4) | (v >> 4)); }
+				continue;
+			}
+			const uint16_t* px = (const uint16_t*)src + j * 4;
+			if (WideGamut)
+			{
+				const float r = HalfBitsToLinear(px[0]), g = HalfBitsToLinear(px[1]), b = HalfBitsToLinear(px[2]);
+				dst[0] = ttbl[LinearToHalfBits(m[6] * r + m[7] * g + m[8] * b)], dst[1] = ttbl[LinearToHalfBits(m[3] * r + m[4] * g + m[5] * b)];
+				dst[2] = ttbl[LinearToHalfBits(m[0] * r + m[1] * g + m[2] * b)], dst[3] = ttbl[px[3]];
+				continue;
+			}
+			dst[0] = ttbl[px[2]], dst[1] = ttbl[px[1]], dst[2] = ttbl[px[0]], dst[3] = ttbl[px[3]];
+		}
+	}
+
+	template <int In, bool Mirror, bool WideGamut> PROCESS_TARGET_AVX2 static void ConvertRowDeep_AVX2(const void* src, uint16_t* dst, size_t n, const uint16_t* ttbl)
+	{
+		//Looks up 4 FP16 pixels per step in the 12 bit table with two gathers (4 byte reads masked to the 16 bit entry)
+		//The 32 bit results get swizzled to BGRA within each lane, packed to 16 bit and the pixel order restored (or reversed) with a permute
+		const __m256i Mask = _mm256_set1_epi32(0xFFFF);
+		const float* m = GetBT2020Primaries();
+		const __m256 M0 = _mm256_setr_ps(m[0], m[3], m[6], 0, m[0], m[3], m[6], 0), M1 = _mm256_setr_ps(m[1], m[4], m[7], 0, m[1], m[4], m[7], 0), M2 = _mm256_setr_ps(m[2], m[5], m[8], 0, m[2], m[5], m[8], 0);
+		const uint16_t* s = (const uint16_t*)src + (Mirror ? n * 4 : 0);
+		for (; n >= 4; n -= 4, dst += 16)
+		{
+			if (Mirror) s -= 16;
+			__m256i ia = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)s)), ib = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(s + 8)));
+			if (WideGamut) ia = ToBT2020_AVX2(ia, M0, M1, M2), ib = ToBT2020_AVX2(ib, M0, M1, M2);
+			__m256i a = _mm256_and_si256(_mm256_i32gather_epi32((const int*)ttbl, ia, 2), Mask);
+			__m256i b = _mm256_and_si256(_mm256_i32gather_epi32((const int*)ttbl, ib, 2), Mask);
+			a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 0, 1, 2));
+			b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 0, 1, 2));
+			_mm256_storeu_si256((__m256i*)dst, _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), (Mirror ? _MM_SHUFFLE(0, 2, 1, 3) : _MM_SHUFFLE(3, 1, 2, 0))));
+			if (!Mirror) s += 16;
+		}
+		_mm256_zeroupper();
+		ConvertRowDeep_Scalar<In, Mirror, WideGamut>((Mirror ? src : (const void*)s), dst, n, ttbl); //remaining pixels (at the row start when mirrored)
+	}
+
+	PROCESS_TARGET_AVX2 static __m256i ToBT2020_AVX2(__m256i h, __m256 M0, __m256 M1, __m256 M2)
+	{
+		//Two pixels of 16 bit float bits (one per 32 bit value) get decoded, mixed by the matrix columns and rounded back like the scalar
+		//HalfBitsToLinear and LinearToHalfBits, alpha keeps its bits
+		const __m256i Sign = _mm256_set1_epi32(0x8000), Exp = _mm256_set1_epi32(0x7C00);
+		const __m256 Denormal = _mm256_set1_ps(1.0f / 16777216.0f), Normal = _mm256_set1_ps(1.0f / 16384.0f);
+		__m256 v = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_slli_epi32(h, 13), _mm256_set1_epi32(0x38000000)));
+		v = _mm256_blendv_ps(v, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(h, _mm256_set1_epi32(0x3FF))), Denormal), _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h, Exp), _mm256_setzero_si256())));
+		v = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(h, Sign), Sign)), v);
+		__m256 o = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(M0, _mm256_shuffle_ps(v, v, 0x00)), _mm256_mul_ps(M1, _mm256_shuffle_ps(v, v, 0x55))), _mm256_mul_ps(M2, _mm256_shuffle_ps(v, v, 0xAA)));
+		__m256i i = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_castps_si256(o), _mm256_set1_epi32(0x38000000 - 0x1000)), 13);
+		i = _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()), _mm256_set1_epi32(0x7FFF));
+		i = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(i), _mm256_castsi256_ps(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(o, _mm256_set1_ps(16777216.0f)), _mm256_set1_ps(0.5f)))), _mm256_cmp_ps(o, Normal, _CMP_LT_OQ)));
+		return _mm256_blend_epi32(i, h, 0x88);
+	}
+
+	static void CopyRow(const void* src, uint8_t* dst, size_t n, const uint8_t*)
+	{
+		memcpy(dst, src, n * 4);
+	}
+
+	static __forceinline float HalfBitsToFloat(uint32_t h)
+	{
+		//Unsigned half float (or 11/10 bit float shifted to half precision) to float, infinity/NaN become large numbers
+		//Denormals become 0 which doesn't change the 8 bit result as everything below 2^-13 maps to 0 (or the first sRGB segment)
+		uint32_t Bits = (h & 0x7C00 ? (h << 13) + 0x38000000 : 0);
+		float f;
+		memcpy(&f, &Bits, 4);
+		return f;
+	}
+
+	template <bool SRGB> static __forceinline uint32_t FloatToU8(float f)
+	{
+		//Scalar version of FloatToU8_AVX2 with the same results, negative values become 0 and NaN becomes 255
+		uint32_t Bits;
+		memcpy(&Bits, &f, 4);
+		if (Bits & 0x80000000) return 0;
+		if (!SRGB) return (uint32_t)((f < 1.0f ? f : 1.0f) * 255.9999f);
+		const float MinF = 1.0f / 8192.0f;
+		f = (f < 0.99999994f ? f : 0.99999994f);
+		f = (f > MinF ? f : MinF);
+		memcpy(&Bits, &f, 4);
+		const uint32_t Segment = (Bits - SRGBSegmentTable::MIN_BITS) >> 20;
+		return (uint32_t)(f * SRGBSegments.Scale[Segment] + SRGBSegments.Bias[Segment]);
+	}
+
+	template <int In> static __forceinline uint32_t FetchBGRA(const void* src, size_t i, const uint8_t* ttbl)
+	{
+		if (In == IN_BGRA8) return ((const uint32_t*)src)[i];
+		if (In == IN_RGBA8) { uint32_t x = ((const uint32_t*)src)[i]; return ((x&0xFF00FF00)|((x&0x00FF0000)>>16)|((x&0x000000FF)<<16)); }
+		enum { SRGB = Input<In>::SRGB };
+		if (In == IN_RGB10A2_GAMMA || In == IN_RGB10A2_SRGB)
+		{
+			//10 bit unsigned normalized color with 2 bit alpha, gamma values only need the lowest 2 bits dropped
+			uint32_t x = ((const uint32_t*)src)[i], r = x & 1023, g = (x >> 10) & 1023, b = (x >> 20) & 1023, a = (x >> 30) * 85;
+			if (SRGB) r = FloatToU8<true>(r * (1.0f / 1023.0f)), g = FloatToU8<true>(g * (1.0f / 1023.0f)), b = FloatToU8<true>(b * (1.0f / 1023.0f));
+			else r >>= 2, g >>= 2, b >>= 2;
+			return ((a<<24) | (r<<16) | (g<<8) | b);
+		}
+		if (In == IN_R11G11B10F_GAMMA || In == IN_R11G11B10F_SRGB)
+		{
+			//Unsigned 11 and 10 bit floats are half floats without the sign bit and with the lower mantissa bits cut off, alpha is opaque
+			uint32_t x = ((const uint32_t*)src)[i];
+			return (0xFF000000 | (FloatToU8<SRGB>(HalfBitsToFloat((x & 0x7FF) << 4))<<16) | (FloatToU8<SRGB>(HalfBitsToFloat(((x >> 11) & 0x7FF) << 4))<<8) | FloatToU8<SRGB>(HalfBitsToFloat((x >> 22) << 5)));
+		}
+		if (In == IN_RGBA32F_GAMMA || In == IN_RGBA32F_SRGB)
+		{
+			//Alpha is always linear (unlike the FP16 table which also applies the sRGB curve to alpha)
+			const float* px = (const float*)src + (i * 4);
+			return ((FloatToU8<false>(px[3])<<24) | (FloatToU8<SRGB>(px[0])<<16) | (FloatToU8<SRGB>(px[1])<<8) | FloatToU8<SRGB>(px[2]));
+		}
+		//16 bit color downscaling (HDR (16 bit floats) to BGRA) with a lookup table
+		const uint16_t* px = (const uint16_t*)src + (i * 4);
+		return ((ttbl[px[3]]<<24) | (ttbl[px[0]]<<16) | (ttbl[px[1]]<<8) | ttbl[px[2]]);
+	}
+
+	template <int In, int OutBPP, bool Mirror> static void ConvertRow_Scalar(const void* src, uint8_t* dst, size_t n, const uint8_t* ttbl)
+	{
+		//For 3 byte output each pixel is written with 4 bytes which get overlapped by the next one, only the final pixel uses a 3 byte copy
+		if (!n) return;
+		for (size_t i = 0, iLast = n - 1; i != iLast; i++, dst += OutBPP)
+			*(uint32_t*)dst = FetchBGRA<In>(src, (Mirror ? iLast - i : i), ttbl);
+		uint32_t FinalPixel = FetchBGRA<In>(src, (Mirror ? 0 : n - 1), ttbl);
+		memcpy(dst, &FinalPixel, OutBPP);
+	}
+
+	template <int In, int OutBPP, bool Mirror> PROCESS_TARGET_SSSE3 static void ConvertRow_SSSE3(const void* src, uint8_t* dst, size_t n, const uint8_t* ttbl)
+	{
+		//Shuffle 4 RGBA (or BGRA) pixels into BGRA or 12 BGR bytes (4 of which get merged into 3 full 16 byte stores)
+		//Mirroring reads the 4 pixel blocks from the end of the row and reverses them with the same shuffle
+		enum { R = Input<In>::R, B = Input<In>::B };
+		const __m128i shuf = (OutBPP == 3 ? (Mirror ? _mm_setr_epi8(12+B, 13, 12+R, 8+B, 9, 8+R, 4+B, 5, 4+R, B, 1, R, -1, -1, -1, -1) : _mm_setr_epi8(B, 1, R, 4+B, 5, 4+R, 8+B, 9, 8+R, 12+B, 13, 12+R, -1, -1, -1, -1))
+		                                  : (Mirror ? _mm_setr_epi8(12+B, 13, 12+R, 15, 8+B, 9, 8+R, 11, 4+B, 5, 4+R, 7, B, 1, R, 3) : _mm_setr_epi8(B, 1, R, 3, 4+B, 5, 4+R, 7, 8+B, 9, 8+R, 11, 12+B, 13, 12+R, 15)));
+		const uint32_t* s = (const uint32_t*)src + (Mirror ? n : 0);
+		#define SSSE3_LOAD(i) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Mirror ? s - 4 * ((i) + 1) : s + 4 * (i))), shuf)
+		for (; n >= 16; n -= 16, dst += 16 * OutBPP, s += (Mirror ? -16 : 16))
+		{
+			__m128i a = SSSE3_LOAD(0), b = SSSE3_LOAD(1), c = SSSE3_LOAD(2), d = SSSE3_LOAD(3);
+			if (OutBPP == 3)
+			{
+				_mm_storeu_si128((__m128i*)(dst     ), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+				_mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+				_mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+			}
+			else
+			{
+				_mm_storeu_si128((__m128i*)dst + 0, a);
+				_mm_storeu_si128((__m128i*)dst + 1, b);
+				_mm_storeu_si128((__m128i*)dst + 2, c);
+				_mm_storeu_si128((__m128i*)dst + 3, d);
+			}
+		}
+		#undef SSSE3_LOAD
+		ConvertRow_Scalar<In, OutBPP, Mirror>((Mirror ? src : s), dst, n, ttbl);
+	}
+
+	PROCESS_TARGET_AVX2 static __forceinline __m256i HalfTableToU8_AVX2(__m128i h, const uint8_t* ttbl)
+	{
+		//Look up 8 half floats in the 8 bit table (in 32 bit lanes), each gather reads 4 bytes of which only the lowest one is kept
+		return _mm256_and_si256(_mm256_i32gather_epi32((const int*)ttbl, _mm256_cvtepu16_epi32(h), 1), _mm256_set1_epi32(0xFF));
+	}
+
+	template <bool SRGB> PROCESS_TARGET_AVX2 static __forceinline __m256i HalfToU8_AVX2(__m128i h)
+	{
+		//Convert 8 half floats to 8 bit values (in 32 bit lanes) matching the results of the lookup table
+		return FloatToU8_AVX2<SRGB>(_mm256_cvtph_ps(h));
+	}
+
+	template <bool SRGB> PROCESS_TARGET_AVX2 static __forceinline __m256i FloatToU8_AVX2(__m256 f)
+	{
+		//Like the FP16 table, anything with the sign bit set becomes 0 and infinity/NaN become 255 (min before max keeps NaN as white)
+		__m256i Negative = _mm256_srai_epi32(_mm256_castps_si256(f), 31);
+		if (!SRGB) return _mm256_andnot_si256(Negative, _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_max_ps(_mm256_min_ps(f, _mm256_set1_ps(1.0f)), _mm256_setzero_ps()), _mm256_set1_ps(255.9999f))));
+		const __m256i MinBits = _mm256_set1_epi32(SRGBSegmentTable::MIN_BITS);
+		f = _mm256_max_ps(_mm256_min_ps(f, _mm256_set1_ps(0.99999994f)), _mm256_castsi256_ps(MinBits));
+		__m256i Segment = _mm256_srli_epi32(_mm256_sub_epi32(_mm256_castps_si256(f), MinBits), 20);
+		__m256 Scale = _mm256_i32gather_ps(SRGBSegments.Scale, Segment, 4), Bias = _mm256_i32gather_ps(SRGBSegments.Bias, Segment, 4);
+		return _mm256_andnot_si256(Negative, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(f, Scale), Bias)));
+	}
+
+	PROCESS_TARGET_AVX2 static __forceinline __m256 SmallFloatToFloat_AVX2(__m256i v)
+	{
+		//Rebias the exponent of half float bits that are already shifted into float position, denormals become 0 (see HalfBitsToFloat)
+		const __m256i Exp = _mm256_and_si256(v, _mm256_set1_epi32(0x0F800000));
+		return _mm256_castsi256_ps(_mm256_andnot_si256(_mm256_cmpeq_epi32(Exp, _mm256_setzero_si256()), _mm256_add_epi32(v, _mm256_set1_epi32(0x38000000))));
+	}
+
+	template <int In> PROCESS_TARGET_AVX2 static __forceinline __m256i Load2Float_AVX2(const void* src)
+	{
+		//Two RGBA32F pixels to 8 bit values in 32 bit lanes, with the alpha lanes taken from the linear conversion
+		__m256 f = _mm256_loadu_ps((const float*)src);
+		return (Input<In>::SRGB ? _mm256_blend_epi32(FloatToU8_AVX2<true>(f), FloatToU8_AVX2<false>(f), 0x88) : FloatToU8_AVX2<false>(f));
+	}
+
+	template <int In> PROCESS_TARGET_AVX2 static __forceinline __m256i Load8_AVX2(const void* src, const uint8_t* ttbl)
+	{
+		//Load 8 pixels as RGBA8 (or BGRA8), for half and full floats each 128 bit lane of the conversion results holds one pixel so after
+		//packing the low lane has pixels 0,2,4,6 and the high lane 1,3,5,7 which the final permute puts back in order
+		//Half floats go through the table if there is one (for the HDR curves), otherwise they get converted with F16C
+		enum { SRGB = Input<In>::SRGB };
+		if (Input<In>::U8) return _mm256_loadu_si256((const __m256i*)src);
+		if (Input<In>::BPP == 4)
+		{
+			//The packed formats convert each channel of 8 pixels separately and then merge the channels into RGBA
+			const __m256i x = _mm256_loadu_si256((const __m256i*)src), Mask10 = _mm256_set1_epi32(1023), Mask11 = _mm256_set1_epi32(0x7FF0);
+			if (In == IN_RGB10A2_GAMMA || In == IN_RGB10A2_SRGB)
+			{
+				__m256i r = _mm256_and_si256(x, Mask10), g = _mm256_and_si256(_mm256_srli_epi32(x, 10), Mask10), b = _mm256_and_si256(_mm256_srli_epi32(x, 20), Mask10);
+				__m256i a = _mm256_mullo_epi32(_mm256_srli_epi32(x, 30), _mm256_set1_epi32(85 << 24));
+				if (SRGB)
+				{
+					const __m256 Scale = _mm256_set1_ps(1.0f / 1023.0f);
+					r = FloatToU8_AVX2<true>(_mm256_mul_ps(_mm256_cvtepi32_ps(r), Scale));
+					g = FloatToU8_AVX2<true>(_mm256_mul_ps(_mm256_cvtepi32_ps(g), Scale));
+					b = FloatToU8_AVX2<true>(_mm256_mul_ps(_mm256_cvtepi32_ps(b), Scale));
+				}
+				else r = _mm256_srli_epi32(r, 2), g = _mm256_srli_epi32(g, 2), b = _mm256_srli_epi32(b, 2);
+				return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), a));
+			}
+			//Same bit conversion as HalfBitsToFloat with the 11/10 bit floats placed at the float position of a half float
+			__m256i r = _mm256_slli_epi32(_mm256_and_si256(_mm256_slli_epi32(x, 4), Mask11), 13), g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(x, 7), Mask11), 13), b = _mm256_slli_epi32(_mm256_srli_epi32(x, 22), 18);
+			r = FloatToU8_AVX2<SRGB>(SmallFloatToFloat_AVX2(r));
+			g = FloatToU8_AVX2<SRGB>(SmallFloatToFloat_AVX2(g));
+			b = FloatToU8_AVX2<SRGB>(SmallFloatToFloat_AVX2(b));
+			return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32(0xFF000000)));
+		}
+		__m256i p01, p23, p45, p67;
+		if (Input<In>::BPP == 16)
+		{
+			const float* s = (const float*)src;
+			p01 = Load2Float_AVX2<In>(s), p23 = Load2Float_AVX2<In>(s + 8), p45 = Load2Float_AVX2<In>(s + 16), p67 = Load2Float_AVX2<In>(s + 24);
+		}
+		else
+		{
+			const __m128i* s = (const __m128i*)src;
+			if (ttbl)
+			{
+				p01 = HalfTableToU8_AVX2(_mm_loadu_si128(s + 0), ttbl), p23 = HalfTableToU8_AVX2(_mm_loadu_si128(s + 1), ttbl);
+				p45 = HalfTableToU8_AVX2(_mm_loadu_si128(s + 2), ttbl), p67 = HalfTableToU8_AVX2(_mm_loadu_si128(s + 3), ttbl);
+			}
+			else
+			{
+				p01 = HalfToU8_AVX2<SRGB>(_mm_loadu_si128(s + 0)), p23 = HalfToU8_AVX2<SRGB>(_mm_loadu_si128(s + 1));
+				p45 = HalfToU8_AVX2<SRGB>(_mm_loadu_si128(s + 2)), p67 = HalfToU8_AVX2<SRGB>(_mm_loadu_si128(s + 3));
+			}
+		}
+		__m256i Packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23), _mm256_packs_epi32(p45, p67));
+		return _mm256_permutevar8x32_epi32(Packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+	}
+
+	template <int In, int OutBPP, bool Mirror> PROCESS_TARGET_AVX2 static void ConvertRow_AVX2(const void* src, uint8_t* dst, size_t n, const uint8_t* ttbl)
+	{
+		//Converts 8 pixels per step, for 3 byte output the swizzle leaves 12 bytes per lane which get packed to the low 24 bytes
+		//and written with a 32 byte store that gets overlapped by the next step, so keep 3 pixels (9 bytes) of room to the row end
+		//Mirroring reads the 8 pixel blocks from the end of the row and reverses them with the shuffle and lane permute
+		enum { InBPP = Input<In>::BPP, R = Input<In>::R, B = Input<In>::B };
+		const __m256i shuf = (OutBPP == 3 ?
+			(Mirror ? _mm256_setr_epi8(12+B, 13, 12+R, 8+B, 9, 8+R, 4+B, 5, 4+R, B, 1, R, -1, -1, -1, -1, 12+B, 13, 12+R, 8+B, 9, 8+R, 4+B, 5, 4+R, B, 1, R, -1, -1, -1, -1)
+			        : _mm256_setr_epi8(B, 1, R, 4+B, 5, 4+R, 8+B, 9, 8+R, 12+B, 13, 12+R, -1, -1, -1, -1, B, 1, R, 4+B, 5, 4+R, 8+B, 9, 8+R, 12+B, 13, 12+R, -1, -1, -1, -1)) :
+			(Mirror ? _mm256_setr_epi8(12+B, 13, 12+R, 15, 8+B, 9, 8+R, 11, 4+B, 5, 4+R, 7, B, 1, R, 3, 12+B, 13, 12+R, 15, 8+B, 9, 8+R, 11, 4+B, 5, 4+R, 7, B, 1, R, 3)
+			        : _mm256_setr_epi8(B, 1, R, 3, 4+B, 5, 4+R, 7, 8+B, 9, 8+R, 11, 12+B, 13, 12+R, 15, B, 1, R, 3, 4+B, 5, 4+R, 7, 8+B, 9, 8+R, 11, 12+B, 13, 12+R, 15)));
+		const __m256i perm = (OutBPP == 3 ? (Mirror ? _mm256_setr_epi32(4, 5, 6, 0, 1, 2, 3, 7) : _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)) : _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3));
+		const uint8_t* s = (const uint8_t*)src + (Mirror ? n * InBPP : 0);
+		for (; n >= 8 + (OutBPP == 3 ? 3 : 0); n -= 8, dst += 8 * OutBPP)
+		{
+			if (Mirror) s -= 8 * InBPP;
+			__m256i px = _mm256_shuffle_epi8(Load8_AVX2<In>(s, (Input<In>::HALF ? ttbl : NULL)), shuf);
+			if (OutBPP == 3 || Mirror) px = _mm256_permutevar8x32_epi32(px, perm);
+			_mm256_storeu_si256((__m256i*)dst, px);
+			if (!Mirror) s += 8 * InBPP;
+		}
+		for (size_t Count; n; n -= Count, dst += Count * OutBPP)
+		{
+			//Convert the remaining pixels through small buffers (mirrored pixels are placed at the end of the input block)
+			uint8_t TailIn[8 * InBPP], TailOut[32];
+			Count = (n < 8 ? n : 8);
+			memset(TailIn, 0, sizeof(TailIn));
+			if (Mirror) memcpy(TailIn + (8 - Count) * InBPP, (s -= Count * InBPP), Count * InBPP);
+			else { memcpy(TailIn, s, Count * InBPP); s += Count * InBPP; }
+			__m256i px = _mm256_shuffle_epi8(Load8_AVX2<In>(TailIn, (Input<In>::HALF ? ttbl : NULL)), shuf);
+			if (OutBPP == 3 || Mirror) px = _mm256_permutevar8x32_epi32(px, perm);
+			_mm256_storeu_si256((__m256i*)TailOut, px);
+			memcpy(dst, TailOut, Count * OutBPP);
+		}
+		_mm256_zeroupper();
+	}
+
+	template <int In, bool Clockwise> void Rotate()
+	{
+		//Turn the source by 90 degrees into a BGRA image of Width x Height (so the source is Height pixels wide and Width rows tall)
+		//This works in tiles of 32x32 pixels, the source row pieces of a tile get converted into a small buffer which then gets transposed
+		//in 4x4 pixel blocks into the output rows, that way reads and writes both stay within a few cache lines per row
+		//The row pieces of the next tile get prefetched as the hardware prefetcher doesn't pick up this access pattern
+		enum { TILE = 32 };
+		const RowFunc ConvertRow = GetConvertRow<In, 4, false>();
+		const size_t InPitch = RGBAInStride * Input<In>::BPP, SrcW = Height, SrcH = Width;
+		uint32_t* Tile = (uint32_t*)Scratch->Get(TILE * TILE * 4);
+		for (size_t ty = RowStart, th; ty < RowEnd; ty += th)
+		{
+			//Output rows ty to ty+th are the source columns sx to sx+th, output columns tx to tx+tw are the source rows sy to sy+tw
+			th = min((size_t)TILE, RowEnd - ty);
+			const size_t sx = (Clockwise ? SrcW - ty - th : ty);
+			for (size_t tx = 0, tw; tx < Width; tx += tw)
+			{
+				tw = min((size_t)TILE, Width - tx);
+				const size_t sy = (Clockwise ? tx : SrcH - tx - tw);
+				const bool Prefetch = (Clockwise ? sy + tw + TILE <= SrcH : sy >= TILE);
+				for (size_t r = 0; r != tw; r++)
+				{
+					const uint8_t* src = (const uint8_t*)BufIn + (sy + r) * InPitch + sx * Input<In>::BPP;
+					if (Prefetch) for (size_t b = 0; b < th * Input<In>::BPP; b += 64) _mm_prefetch((const char*)(Clockwise ? src + TILE * InPitch : src - TILE * InPitch) + b, _MM_HINT_T0);
+					ConvertRow(src, (uint8_t*)(Tile + r * TILE), th, RGBA16Table);
+				}
+				TransposeTile<Clockwise>(Tile, TILE, (uint32_t*)BufOut + ty * Width + tx, Width, tw, th);
+			}
+			for (size_t r = 0; (AlphaMode != ALPHA_KEEP || Stats) && r != th; r++)
+			{
+				ConvertAlphaRow((uint8_t*)BufOut + (ty + r) * Width * 4, Width);
+				if (Stats) Stats->AddRow<4, true>((uint8_t*)BufOut + (ty + r) * Width * 4, Width);
+			}
+		}
+	}
+
+	template <bool Clockwise> void RotateRaw()
+	{
+		//Turn 8 byte (FP16) source pixels by 90 degrees without converting them, for the 10 bit outputs which then read the turned image
+		//like the source (with RGBAInStride = Width) so it keeps the precision of the 12 bit tables, tiled like Rotate
+		enum { TILE = 32 };
+		const size_t SrcW = Height, SrcH = Width, InPitch = RGBAInStride * 8;
+		uint8_t* dst = (uint8_t*)BufOut;
+		for (size_t ty = RowStart, th; ty < RowEnd; ty += th)
+		{
+			th = min((size_t)TILE, RowEnd - ty);
+			for (size_t tx = 0, tw; tx < Width; tx += tw)
+			{
+				tw = min((size_t)TILE, Width - tx);
+				for (size_t y = ty; y != ty + th; y++)
+				{
+					//Output pixel (x, y) is source pixel (SrcW-1-y, x) when turning clockwise or (y, SrcH-1-x) otherwise (in (column, row) order)
+					const uint8_t* src = (const uint8_t*)BufIn + (Clockwise ? SrcW - 1 - y : y) * 8;
+					for (size_t x = tx; x != tx + tw; x++) memcpy(dst + (y * Width + x) * 8, src + (Clockwise ? x : SrcH - 1 - x) * InPitch, 8);
+				}
+			}
+		}
+	}
+
+	template <bool Clockwise> static void TransposeTile(const uint32_t* Tile, size_t TilePitch, uint32_t* dst, size_t DstPitch, size_t tw, size_t th)
+	{
+		//Writes th output rows of tw pixels where output pixel (j, i) is tile pixel (th-1-i, j) when turning clockwise or (i, tw-1-j) otherwise
+		//(in (column, row) order), the 4x4 blocks load the tile rows in reverse for counter-clockwise and store the columns in reverse for clockwise
+		#define TILE_PIXEL(i, j) (Clockwise ? Tile[(j) * TilePitch + th - 1 - (i)] : Tile[(tw - 1 - (j)) * TilePitch + (i)])
+		const size_t th4 = th & ~(size_t)3, tw4 = tw & ~(size_t)3;
+		for (size_t i = 0; i != th4; i += 4)
+		{
+			uint32_t* d = dst + i * DstPitch;
+			const size_t Col = (Clockwise ? th - 4 - i : i);
+			for (size_t j = 0; j != tw4; j += 4)
+			{
+				const uint32_t* t = Tile + (Clockwise ? j : tw - 4 - j) * TilePitch + Col;
+				__m128i r0 = _mm_loadu_si128((const __m128i*)(t + (Clockwise ? 0 : 3) * TilePitch)), r1 = _mm_loadu_si128((const __m128i*)(t + (Clockwise ? 1 : 2) * TilePitch));
+				__m128i r2 = _mm_loadu_si128((const __m128i*)(t + (Clockwise ? 2 : 1) * TilePitch)), r3 = _mm_loadu_si128((const __m128i*)(t + (Clockwise ? 3 : 0) * TilePitch));
+				__m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3), t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+				_mm_storeu_si128((__m128i*)(d + (Clockwise ? 3 : 0) * DstPitch + j), _mm_unpacklo_epi64(t0, t1));
+				_mm_storeu_si128((__m128i*)(d + (Clockwise ? 2 : 1) * DstPitch + j), _mm_unpackhi_epi64(t0, t1));
+				_mm_storeu_si128((__m128i*)(d + (Clockwise ? 1 : 2) * DstPitch + j), _mm_unpacklo_epi64(t2, t3));
+				_mm_storeu_si128((__m128i*)(d + (Clockwise ? 0 : 3) * DstPitch + j), _mm_unpackhi_epi64(t2, t3));
+			}
+			for (size_t k = 0; k != 4; k++) for (size_t j = tw4; j != tw; j++) d[k * DstPitch + j] = TILE_PIXEL(i + k, j);
+		}
+		for (size_t i = th4; i != th; i++) for (size_t j = 0; j != tw; j++) dst[i * DstPitch + j] = TILE_PIXEL(i, j);
+		#undef TILE_PIXEL
+	}
+
+	template <int In, int Out, bool Mirror> void Resize()
+	{
+		//Separable resampling straight from the RGBA source into the letterboxed image area, rows fully outside of it are cleared in bulk
+		//Only the source rows needed by the vertical filter taps of this band get converted (and mirrored) to BGRA right before scaling
+		if (Output<Out>::YUV) { ResizeYUV<In, Out, Mirror>(); return; }
+		enum { OutBPP = Output<Out>::BPP };
+		if (OutBPP == 3 && Background) { ResizeComposite<In, Mirror>(); return; }
+		const ResizeCoeffs& rc = *Coeffs;
+		const size_t OutPitch = Width * OutBPP;
+		const size_t ImgRowStart = min(max(RowStart, (size_t)rc.ImgY), RowEnd), ImgRowEnd = max(min(RowEnd, (size_t)(rc.ImgY + rc.ImgH)), ImgRowStart);
+		uint8_t* dst = (uint8_t*)BufOut;
+		if (RowStart < ImgRowStart) memset(dst + RowStart * OutPitch, 0, (ImgRowStart - RowStart) * OutPitch);
+		if (ImgRowEnd < RowEnd) memset(dst + ImgRowEnd * OutPitch, 0, (RowEnd - ImgRowEnd) * OutPitch);
+		if (Stats) Stats->AddBlack((ImgRowStart - RowStart + RowEnd - ImgRowEnd) * Width, OutBPP == 4);
+		if (ImgRowStart == ImgRowEnd) return;
+
+		//Horizontally scaled source rows are kept in a ring with one slot per vertical tap so each one only gets scaled once per band
+		//They are stored as 16 bit values with 7 fractional bits, the row length is padded to a multiple of 4 pixels for the vertical pass
+		const size_t RingPitch = ((rc.ImgW + 3) & ~3) * 4;
+		int16_t* Ring = (int16_t*)Scratch->Get(rc.TapsY * RingPitch * sizeof(int16_t) + RingPitch + rc.SrcW * 4 + (StreamOut ? OutPitch : 0));
+		uint8_t *OutRow = (uint8_t*)(Ring + rc.TapsY * RingPitch), *SrcRow = OutRow + RingPitch, *StreamBuf = SrcRow + rc.SrcW * 4;
+		const size_t LeftBytes = rc.ImgX * OutBPP, RightOffset = (rc.ImgX + rc.ImgW) * OutBPP;
+		for (int y = (int)ImgRowStart - rc.ImgY, yEnd = (int)ImgRowEnd - rc.ImgY, NextRow = 0; y != yEnd; y++)
+		{
+			ResizeRow<In, Mirror>(y, NextRow, Ring, RingPitch, SrcRow, OutRow);
+			uint8_t* d = (StreamOut ? StreamBuf : dst + (y + rc.ImgY) * OutPitch);
+			memset(d, 0, LeftBytes);
+			if (OutBPP == 4) ConvertAlphaRow(OutRow, rc.ImgW), memcpy(d + LeftBytes, OutRow, rc.ImgW * 4);
+			else for (uint8_t *s = OutRow, *o = d + LeftBytes, *oEnd = o + rc.ImgW * 3; o != oEnd; s += 4, o += 3) { o[0] = s[0]; o[1] = s[1]; o[2] = s[2]; }
+			if (Stats) Stats->AddRow<4, OutBPP == 4>(OutRow, rc.ImgW), Stats->AddBlack(Width - rc.ImgW, OutBPP == 4);
+			memset(d + RightOffset, 0, OutPitch - RightOffset);
+			if (StreamOut) StreamingCopy(dst + (y + rc.ImgY) * OutPitch, d, OutPitch, false);
+		}
+	}
+
+	template <int In, int Out, bool Mirror> void ResizeYUV()
+	{
+		//Scaled rows get placed into full width BGRA rows with black borders which then get converted 1 or 2 rows at a time
+		//The YUV rows of the band are walked bottom to top so the (bottom-up) image rows are still scaled in ascending order for the ring
+		enum { Step = Output<Out>::CHROMA_ROWS };
+		if (Output<Out>::DEEP && Input<In>::HALF) { ResizeYUVDeep<In, Out, Mirror>(); return; }
+		const ResizeCoeffs& rc = *Coeffs;
+		const size_t RingPitch = ((rc.ImgW + 3) & ~3) * 4, RowPitch = Width * 4 + 16, RightOffset = (rc.ImgX + rc.ImgW) * 4;
+		int16_t* Ring = (int16_t*)Scratch->GetZeroed(rc.TapsY * RingPitch * sizeof(int16_t) + (Step + 1) * RowPitch + rc.SrcW * 4);
+		uint8_t *Rows = (uint8_t*)(Ring + rc.TapsY * RingPitch), *BlackRow = Rows + Step * RowPitch, *SrcRow = BlackRow + RowPitch;
+		const uint8_t* Row[2] = { NULL, NULL };
+		int NextRow = 0;
+		for (size_t i = (RowEnd - RowStart + Step - 1) / Step; i--;)
+		{
+			const size_t y = RowStart + i * Step;
+			for (int k = Step - 1; k >= 0; k--)
+			{
+				if (y + k >= Height) continue;
+				const int r = (int)(Height - 1 - (y + k)) - rc.ImgY;
+				if (r < 0 || r >= rc.ImgH) { Row[k] = BlackRow; continue; }
+				uint8_t* d = Rows + k * RowPitch;
+				ResizeRow<In, Mirror>(r, NextRow, Ring, RingPitch, SrcRow, d + rc.ImgX * 4);
+				memset(d + RightOffset, 0, RowPitch - RightOffset); //clear what the padded vertical pass wrote past the image
+				Row[k] = d;
+			}
+			StoreYUV<Out>(y, Row[0], Row[Step - 1]);
+		}
+	}
+
+	template <int In, int Out, bool Mirror> void ResizeYUVDeep()
+	{
+		//ResizeYUV with 12 bit BGRA rows for FP16 sources and 10 bit output
+		enum { Step = Output<Out>::CHROMA_ROWS };
+		const ResizeCoeffs& rc = *Coeffs;
+		const size_t RingPitch = ((rc.ImgW + 3) & ~3) * 4, RowPitch = Width * 4 + 16, RightOffset = (rc.ImgX + rc.ImgW) * 4;
+		int16_t* Ring = (int16_t*)Scratch->GetZeroed((rc.TapsY * RingPitch + (Step + 1) * RowPitch + rc.SrcW * 4) * sizeof(int16_t));
+		uint16_t *Rows = (uint16_t*)(Ring + rc.TapsY * RingPitch), *BlackRow = Rows + Step * RowPitch, *SrcRow = BlackRow + RowPitch;
+		const uint16_t* Row[2] = { NULL, NULL };
+		int NextRow = 0;
+		for (size_t i = (RowEnd - RowStart + Step - 1) / Step; i--;)
+		{
+			const size_t y = RowStart + i * Step;
+			for (int k = Step - 1; k >= 0; k--)
+			{
+				if (y + k >= Height) continue;
+				const int r = (int)(Height - 1 - (y + k)) - rc.ImgY;
+				if (r < 0 || r >= rc.ImgH) { Row[k] = BlackRow; continue; }
+				uint16_t* d = Rows + k * RowPitch;
+				ResizeRowDeep<In, Mirror>(r, NextRow, Ring, RingPitch, SrcRow, d + rc.ImgX * 4);
+				memset(d + RightOffset, 0, (RowPitch - RightOffset) * sizeof(uint16_t));
+				Row[k] = d;
+			}
+			if (Stats) { Stats->AddRowDeep(Row[0], Width); if (Step == 2 && y + 1 < Height) Stats->AddRowDeep(Row[1], Width); }
+			StoreYUVDeep<Out>(y, Row[0], Row[Step - 1], 0, Width);
+		}
+	}
+
+	template <int In, bool Mirror> void ResizeComposite()
+	{
+		//Scaled rows get placed into full width BGRA rows with transparent borders (like ResizeYUV) so the borders show the background too
+		const ResizeCoeffs& rc = *Coeffs;
+		const size_t RingPitch = ((rc.ImgW + 3) & ~3) * 4, RowPitch = Width * 4 + 16, RightOffset = (rc.ImgX + rc.ImgW) * 4;
+		int16_t* Ring = (int16_t*)Scratch->GetZeroed(rc.TapsY * RingPitch * sizeof(int16_t) + RowPitch * 2 + rc.SrcW * 4);
+		uint8_t *Row = (uint8_t*)(Ring + rc.TapsY * RingPitch), *ClearRow = Row + RowPitch, *SrcRow = ClearRow + RowPitch;
+		int NextRow = 0;
+		for (size_t y = RowStart; y != RowEnd; y++)
+		{
+			const int r = (int)y - rc.ImgY;
+			if (r < 0 || r >= rc.ImgH) { StoreComposite(y, ClearRow); continue; }
+			ResizeRow<In, Mirror>(r, NextRow, Ring, RingPitch, SrcRow, Row + rc.ImgX * 4);
+			memset(Row + RightOffset, 0, RowPitch - RightOffset); //clear what the padded vertical pass wrote past the image
+			StoreComposite(y, Row);
+		}
+	}
+
+	template <int In, bool Mirror> void ResizeRow(int y, int& NextRow, int16_t* Ring, size_t RingPitch, uint8_t* SrcRow, uint8_t* OutRow)
+	{
+		//Scale image row y vertically into OutRow after converting and horizontally scaling the source rows of its taps not yet in the ring
+		const ResizeCoeffs& rc = *Coeffs;
+		const RowFunc ConvertRow = GetConvertRow<In, 4, Mirror>();
+		const int sy = rc.StartY[y];
+		for (NextRow = max(NextRow, sy); NextRow < sy + rc.TapsY; NextRow++)
+		{
+			ConvertRow((const uint8_t*)BufIn + (FlipSource ? rc.SrcH - 1 - NextRow : NextRow) * RGBAInStride * Input<In>::BPP, SrcRow, rc.SrcW, RGBA16Table);
+			ResizeRowH(SrcRow, Ring + (NextRow % rc.TapsY) * RingPitch, rc);
+		}
+		ResizeRowV(Ring, RingPitch, sy, rc.TapsY, rc.WeightsY + y * rc.TapsY, OutRow, RingPitch / 16);
+	}
+
+	template <int In, bool Mirror> void ResizeRowDeep(int y, int& NextRow, int16_t* Ring, size_t RingPitch, uint16_t* SrcRow, uint16_t* OutRow)
+	{
+		//ResizeRow with the source rows converted to 12 bit BGRA
+		const ResizeCoeffs& rc = *Coeffs;
+		const DeepRowFunc ConvertRow = GetConvertRowDeep<In, Mirror>(WideGamut);
+		const int sy = rc.StartY[y];
+		for (NextRow = max(NextRow, sy); NextRow < sy + rc.TapsY; NextRow++)
+		{
+			ConvertRow((const uint8_t*)BufIn + (FlipSource ? rc.SrcH - 1 - NextRow : NextRow) * RGBAInStride * Input<In>::BPP, SrcRow, rc.SrcW, RGBA16Table12);
+			ResizeRowHDeep(SrcRow, Ring + (NextRow % rc.TapsY) * RingPitch, rc);
+		}
+		ResizeRowV(Ring, RingPitch, sy, rc.TapsY, rc.WeightsY + y * rc.TapsY, OutRow, RingPitch / 16);
+	}
+
+	static void ResizeRowH(const uint8_t* src, int16_t* dst, const ResizeCoeffs& rc)
+	{
+		//Two taps per step, interleaving the bytes of two pixels lines up each channel pair with the weight pair for one multiply-add
+		const __m128i Zero = _mm_setzero_si128(), Round = _mm_set1_epi32(1 << (ResizeCoeffs::WEIGHT_BITS - 8));
+		const int16_t* w = rc.WeightsX;
+		for (int x = 0, Taps = rc.TapsX; x != rc.ImgW; x++, dst += 4, w += Taps)
+		{
+			const uint8_t* s = src + rc.StartX[x] * 4;
+			__m128i Acc = Round;
+			int t = 0;
+			for (; t + 2 <= Taps; t += 2)
+			{
+				__m128i px = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)(s + t * 4)), _mm_cvtsi32_si128(*(const int*)(s + t * 4 + 4))), Zero);
+				Acc = _mm_add_epi32(Acc, _mm_madd_epi16(px, _mm_set1_epi32((uint16_t)w[t] | ((uint32_t)(uint16_t)w[t + 1] << 16))));
+			}
+			if (t != Taps)
+			{
+				__m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)(s + t * 4)), Zero), Zero);
+				Acc = _mm_add_epi32(Acc, _mm_madd_epi16(px, _mm_set1_epi32((uint16_t)w[t])));
+			}
+			Acc = _mm_srai_epi32(Acc, ResizeCoeffs::WEIGHT_BITS - 7);
+			_mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(Acc, Acc));
+		}
+	}
+
+	static void ResizeRowHDeep(const uint16_t* src, int16_t* dst, const ResizeCoeffs& rc)
+	{
+		//ResizeRowH for 12 bit BGRA rows, the results keep 3 fractional bits which gives the ring values the same range as the 8 bit ones
+		const __m128i Zero = _mm_setzero_si128(), Round = _mm_set1_epi32(1 << (ResizeCoeffs::WEIGHT_BITS - 4));
+		const int16_t* w = rc.WeightsX;
+		for (int x = 0, Taps = rc.TapsX; x != rc.ImgW; x++, dst += 4, w += Taps)
+		{
+			const uint16_t* s = src + rc.StartX[x] * 4;
+			__m128i Acc = Round;
+			int t = 0;
+			for (; t + 2 <= Taps; t += 2)
+			{
+				__m128i px = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(s + t * 4)), _mm_loadl_epi64((const __m128i*)(s + t * 4 + 4)));
+				Acc = _mm_add_epi32(Acc, _mm_madd_epi16(px, _mm_set1_epi32((uint16_t)w[t] | ((uint32_t)(uint16_t)w[t + 1] << 16))));
+			}
+			if (t != Taps)
+			{
+				__m128i px = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(s + t * 4)), Zero);
+				Acc = _mm_add_epi32(Acc, _mm_madd_epi16(px, _mm_set1_epi32((uint16_t)w[t])));
+			}
+			Acc = _mm_srai_epi32(Acc, ResizeCoeffs::WEIGHT_BITS - 3);
+			_mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(Acc, Acc));
+		}
+	}
+
+	template <typename T> static void ResizeRowV(const int16_t* Ring, size_t RingPitch, int sy, int Taps, const int16_t* w, T* dst, size_t Blocks)
+	{
+		//Weighted sum of the ring rows for 4 pixels (16 values) per step, two rows at a time by interleaving their values
+		//Writes 8 bit values or for 16 bit output (rows of ResizeRowHDeep) 12 bit values
+		enum { SHIFT = ResizeCoeffs::WEIGHT_BITS + (sizeof(T) == 1 ? 7 : 3) };
+		const __m128i Round = _mm_set1_epi32(1 << (SHIFT - 1));
+		for (size_t i = 0; i != Blocks; i++, dst += 16)
+		{
+			__m128i Acc0 = Round, Acc1 = Round, Acc2 = Round, Acc3 = Round;
+			int t = 0;
+			for (; t + 2 <= Taps; t += 2)
+			{
+				const __m128i* a = (const __m128i*)(Ring + ((sy + t) % Taps) * RingPitch) + i * 2, *b = (const __m128i*)(Ring + ((sy + t + 1) % Taps) * RingPitch) + i * 2;
+				const __m128i Weight = _mm_set1_epi32((uint16_t)w[t] | ((uint32_t)(uint16_t)w[t + 1] << 16));
+				__m128i a0 = _mm_loadu_si128(a), a1 = _mm_loadu_si128(a + 1), b0 = _mm_loadu_si128(b), b1 = _mm_loadu_si128(b + 1);
+				Acc0 = _mm_add_epi32(Acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a0, b0), Weight));
+				Acc1 = _mm_add_epi32(Acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a0, b0), Weight));
+				Acc2 = _mm_add_epi32(Acc2, _mm_madd_epi16(_mm_unpacklo_epi16(a1, b1), Weight));
+				Acc3 = _mm_add_epi32(Acc3, _mm_madd_epi16(_mm_unpackhi_epi16(a1, b1), Weight));
+			}
+			if (t != Taps)
+			{
+				const __m128i* a = (const __m128i*)(Ring + ((sy + t) % Taps) * RingPitch) + i * 2;
+				const __m128i Weight = _mm_set1_epi32((uint16_t)w[t]), Zero = _mm_setzero_si128();
+				__m128i a0 = _mm_loadu_si128(a), a1 = _mm_loadu_si128(a + 1);
+				Acc0 = _mm_add_epi32(Acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a0, Zero), Weight));
+				Acc1 = _mm_add_epi32(Acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a0, Zero), Weight));
+				Acc2 = _mm_add_epi32(Acc2, _mm_madd_epi16(_mm_unpacklo_epi16(a1, Zero), Weight));
+				Acc3 = _mm_add_epi32(Acc3, _mm_madd_epi16(_mm_unpackhi_epi16(a1, Zero), Weight));
+			}
+			__m128i Lo = _mm_packs_epi32(_mm_srai_epi32(Acc0, SHIFT), _mm_srai_epi32(Acc1, SHIFT)), Hi = _mm_packs_epi32(_mm_srai_epi32(Acc2, SHIFT), _mm_srai_epi32(Acc3, SHIFT));
+			if (sizeof(T) == 1) { _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(Lo, Hi)); continue; }
+			const __m128i Zero = _mm_setzero_si128(), Max = _mm_set1_epi16(4095);
+			_mm_storeu_si128((__m128i*)dst, _mm_min_epi16(_mm_max_epi16(Lo, Zero), Max));
+			_mm_storeu_si128((__m128i*)dst + 1, _mm_min_epi16(_mm_max_epi16(Hi, Zero), Max));
+		}
+	}
+
+	template <int In, int Out, bool Mirror, int N> void Downscale()
+	{
+		//Box filter for exact integer downscale ratios, each output row is produced as BGRA and then stored as BGR(A) or converted to YUV
+		enum { OutBPP = Output<Out>::BPP, Step = Output<Out>::CHROMA_ROWS };
+		if (Output<Out>::DEEP && Input<In>::HALF) { DownscaleDeep<In, Out, Mirror, N>(); return; }
+		const size_t OutPitch = Width * OutBPP, SrcValues = Width * N * 4, RowBytes = (Width + 1) / 2 * 8; //padded for the last pair of an odd width
+		uint16_t* Sums = (uint16_t*)Scratch->Get((SrcValues + N * 4) * sizeof(uint16_t) + SrcValues + RowBytes * 2);
+		uint8_t *SrcRow = (uint8_t*)(Sums + SrcValues + N * 4), *OutRow = SrcRow + SrcValues;
+		if (Output<Out>::YUV)
+		{
+			//Walks the top-down YUV rows, reading the bottom-up source from the end like ConvertYUV
+			for (size_t y = RowStart; y < RowEnd; y += Step)
+			{
+				for (int k = 0; k != Step && y + k < Height; k++) DownscaleRow<In, Mirror, N>(Height - 1 - (y + k), Sums, SrcRow, OutRow + k * RowBytes);
+				StoreYUV<Out>(y, OutRow, OutRow + (Step - 1) * RowBytes);
+			}
+			return;
+		}
+		for (size_t y = RowStart; y != RowEnd; y++)
+		{
+			DownscaleRow<In, Mirror, N>(y, Sums, SrcRow, OutRow);
+			uint8_t* d = (uint8_t*)BufOut + y * OutPitch;
+			if (OutBPP == 4) ConvertAlphaRow(OutRow, Width), (StreamOut ? StreamingCopy(d, OutRow, OutPitch, false) : (void)memcpy(d, OutRow, OutPitch));
+			else if (Background) StoreComposite(y, OutRow);
+			else
+			{
+				//Without streaming the BGR pixels get written in place, otherwise to the (now unused) source row first
+				uint8_t* o = (StreamOut ? SrcRow : d);
+				for (uint8_t *s = OutRow, *oEnd = o + OutPitch; o != oEnd; s += 4, o += 3) { o[0] = s[0]; o[1] = s[1]; o[2] = s[2]; }
+				if (StreamOut) StreamingCopy(d, SrcRow, OutPitch, false);
+			}
+			if (Stats && !Background) Stats->AddRow<4, OutBPP == 4>(OutRow, Width); //composited rows get counted by StoreComposite
+		}
+	}
+
+	template <int In, bool Mirror, int N> void DownscaleRow(size_t y, uint16_t* Sums, uint8_t* SrcRow, uint8_t* OutRow)
+	{
+		//The N source rows of an output row get converted to BGRA and summed up as 16 bit values
+		//Then N pixels of the sums get added for 2 output pixels at once and divided by N*N with rounding (a multiply-high by 65536/9 for 3x3)
+		const size_t InPitch = RGBAInStride * Input<In>::BPP, SrcValues = Width * N * 4, Pairs = (Width + 1) / 2;
+		const RowFunc ConvertRow = GetConvertRow<In, 4, Mirror>();
+		const __m128i Zero = _mm_setzero_si128(), Round = _mm_set1_epi16(N == 3 ? 4 : N * N / 2);
+		for (int r = 0; r != N; r++)
+		{
+			ConvertRow((const uint8_t*)BufIn + (FlipSource ? Height * N - 1 - (y * N + r) : y * N + r) * InPitch, SrcRow, Width * N, RGBA16Table);
+			size_t i = 0;
+			for (; i + 16 <= SrcValues; i += 16)
+			{
+				__m128i px = _mm_loadu_si128((const __m128i*)(SrcRow + i)), Lo = _mm_unpacklo_epi8(px, Zero), Hi = _mm_unpackhi_epi8(px, Zero);
+				if (r) { Lo = _mm_add_epi16(Lo, _mm_loadu_si128((const __m128i*)(Sums + i))); Hi = _mm_add_epi16(Hi, _mm_loadu_si128((const __m128i*)(Sums + i + 8))); }
+				_mm_storeu_si128((__m128i*)(Sums + i), Lo);
+				_mm_storeu_si128((__m128i*)(Sums + i + 8), Hi);
+			}
+			for (; i != SrcValues; i++) Sums[i] = (r ? Sums[i] : 0) + SrcRow[i];
+		}
+		for (size_t x = 0; x != Pairs; x++)
+		{
+			const uint16_t* s = Sums + x * N * 8;
+			__m128i Acc = Round;
+			for (int k = 0; k != N; k++) Acc = _mm_add_epi16(Acc, _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(s + k * 4)), _mm_loadl_epi64((const __m128i*)(s + (N + k) * 4))));
+			Acc = (N == 3 ? _mm_mulhi_epu16(Acc, _mm_set1_epi16(7282)) : _mm_srli_epi16(Acc, (N == 2 ? 2 : 4)));
+			_mm_storel_epi64((__m128i*)(OutRow + x * 8), _mm_packus_epi16(Acc, Acc));
+		}
+	}
+
+	template <int In, int Out, bool Mirror, int N> void DownscaleDeep()
+	{
+		//Downscale with 12 bit BGRA rows for FP16 sources and 10 bit output
+		enum { Step = Output<Out>::CHROMA_ROWS };
+		const size_t SrcValues = Width * N * 4, RowValues = (Width + 1) / 2 * 8;
+		uint16_t* Sums = (uint16_t*)Scratch->Get((SrcValues * 2 + N * 4 + RowValues * 2) * sizeof(uint16_t));
+		uint16_t *SrcRow = Sums + SrcValues + N * 4, *OutRow = SrcRow + SrcValues;
+		for (size_t y = RowStart; y < RowEnd; y += Step)
+		{
+			for (int k = 0; k != Step && y + k < Height; k++)
+			{
+				DownscaleRowDeep<In, Mirror, N>(Height - 1 - (y + k), Sums, SrcRow, OutRow + k * RowValues);
+				if (Stats) Stats->AddRowDeep(OutRow + k * RowValues, Width);
+			}
+			StoreYUVDeep<Out>(y, OutRow, OutRow + (Step - 1) * RowValues, 0, Width);
+		}
+	}
+
+	template <int In, bool Mirror, int N> void DownscaleRowDeep(size_t y, uint16_t* Sums, uint16_t* SrcRow, uint16_t* OutRow)
+	{
+		//DownscaleRow for 12 bit values, the 16 bit sums of up to 4x4 of them still fit (4 * 4 * 4095 + 8 < 65536)
+		//The first source row gets converted straight into the sums, 3x3 is divided with a multiply-high by 8 * 65536/9 (rounded up)
+		//and a shift by 3 which stays exact for sums this large (the 8 bit version only needs the multiply-high by 65536/9)
+		const size_t InPitch = RGBAInStride * Input<In>::BPP, SrcValues = Width * N * 4, Pairs = (Width + 1) / 2;
+		const DeepRowFunc ConvertRow = GetConvertRowDeep<In, Mirror>(WideGamut);
+		const __m128i Round = _mm_set1_epi16(N == 3 ? 4 : N * N / 2);
+		for (int r = 0; r != N; r++)
+		{
+			ConvertRow((const uint8_t*)BufIn + (FlipSource ? Height * N - 1 - (y * N + r) : y * N + r) * InPitch, (r ? SrcRow : Sums), Width * N, RGBA16Table12);
+			if (!r) continue;
+			size_t i = 0;
+			for (; i + 8 <= SrcValues; i += 8) _mm_storeu_si128((__m128i*)(Sums + i), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(Sums + i)), _mm_loadu_si128((const __m128i*)(SrcRow + i))));
+			for (; i != SrcValues; i++) Sums[i] = (uint16_t)(Sums[i] + SrcRow[i]);
+		}
+		for (size_t x = 0; x != Pairs; x++)
+		{
+			const uint16_t* s = Sums + x * N * 8;
+			__m128i Acc = Round;
+			for (int k = 0; k != N; k++) Acc = _mm_add_epi16(Acc, _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(s + k * 4)), _mm_loadl_epi64((const __m128i*)(s + (N + k) * 4))));
+			Acc = (N == 3 ? _mm_srli_epi16(_mm_mulhi_epu16(Acc, _mm_set1_epi16((short)58255)), 3) : _mm_srli_epi16(Acc, (N == 2 ? 2 : 4)));
+			_mm_storeu_si128((__m128i*)(OutRow + x * 8), Acc);
+		}
+	}
+
+	void HashTiles()
+	{
+		//Hashes the source in tiles of TILE_ROWS rows into one 64 bit value per tile in BufOut, RowStart to RowEnd count tiles here
+		//Width is the number of bytes per row, RGBAInStride the row pitch in bytes and Height the number of source rows
+		for (size_t t = RowStart; t != RowEnd; t++)
+			((uint64_t*)BufOut)[t] = HashRows((const uint8_t*)BufIn + t * TILE_ROWS * RGBAInStride, Width, min((size_t)TILE_ROWS, Height - t * TILE_ROWS), RGBAInStride);
+	}
+
+	static uint64_t HashRows(const uint8_t* p, size_t RowBytes, size_t Rows, size_t Pitch)
+	{
+		//Multiply-accumulate hash like the one of XXH3, 4 lanes of two 64 bit sums take 64 bytes per step and get mixed down at the end
+		//The key of the products advances every step so the same content at another position (like a sprite that moved) hashes differently
+		const __m128i KeyStep = _mm_set_epi32((int)0x9E3779B1, (int)0x85EBCA77, (int)0xC2B2AE3D, (int)0x27D4EB2F);
+		__m128i Key = _mm_set_epi32((int)0x165667B1, (int)0xD3A2646C, (int)0xFD7046C5, (int)0xB55A4F09);
+		__m128i Acc[4] = { _mm_set_epi32(0, (int)Rows, 0, (int)RowBytes), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+		uint8_t Tail[64];
+		for (size_t y = 0; y != Rows; y++, p += Pitch)
+		{
+			size_t i = 0;
+			for (; i + 64 <= RowBytes; i += 64, Key = _mm_add_epi32(Key, KeyStep)) HashStep(Acc, p + i, Key);
+			if (i == RowBytes) continue;
+			memset(Tail, 0, 64);
+			memcpy(Tail, p + i, RowBytes - i);
+			HashStep(Acc, Tail, Key);
+			Key = _mm_add_epi32(Key, KeyStep);
+		}
+		uint64_t Lanes[8], h = 0x27D4EB2F165667C5ULL;
+		for (int l = 0; l != 4; l++) _mm_storeu_si128((__m128i*)(Lanes + l * 2), Acc[l]);
+		for (int l = 0; l != 8; l++) h = HashAvalanche(h ^ Lanes[l]) * 0x9E3779B185EBCA87ULL;
+		return HashAvalanche(h);
+	}
+
+	static __forceinline void HashStep(__m128i* Acc, const uint8_t* p, __m128i Key)
+	{
+		//Each lane adds its data with swapped halves and the products of the low and high 32 bits of the keyed data
+		for (int l = 0; l != 4; l++)
+		{
+			const __m128i d = _mm_loadu_si128((const __m128i*)p + l), dk = _mm_xor_si128(d, Key);
+			Acc[l] = _mm_add_epi64(Acc[l], _mm_add_epi64(_mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)), _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32))));
+		}
+	}
+
+	static __forceinline uint64_t HashAvalanche(uint64_t h) { h ^= h >> 37; h *= 0x165667919E3779F9ULL; return h ^ (h >> 32); }
+};
+
+struct ProcessWorkers
+{
+	//Runs the chunks of a job on the calling thread together with a pool of worker threads that all ProcessWorkers of the process share
+	//(one per capture stream), so the number of conversion threads follows the number of logical processors and not the number of streams
+	//Pool threads take one chunk at a time from the job with the earliest deadline (round robin between equal ones), so a stream that is
+	//late for its frame gets helped first and a stream with large frames can't keep the pool from the others
+	//Idle pool threads spin for a while before going to sleep as the next job often follows right away (like the next step of the same frame)
+	//The spin length adapts, it gets longer whenever a job arrived while spinning and shorter whenever a thread had to go to sleep
+	//There is no spinning with more pool threads than logical processors as a spinning thread would then take time from a working one
+	//With all MAX_JOBS slots of the pool in use, further ProcessWorkers get a slot of their own and run their jobs on the calling thread only
+	enum { MAX_THREADS = 64, MAX_JOBS = 128, CHUNKS_PER_THREAD = 4, MIN_CHUNK_ROWS = 16, MIN_SPIN = 256, MAX_SPIN = 32768 };
+
+	ProcessWorkers(int ThreadCount = 0) : FrameTime(0) { Slot = AcquireSlot(); Pooled = (Slot != NULL); if (!Pooled) Slot = new JobSlot; SetThreadCount(ThreadCount); }
+	~ProcessWorkers() { ReleaseSlot(Pooled ? Slot : NULL); if (!Pooled) delete Slot; }
+
+	static int GetDefaultThreadCount()
+	{
+		const int Count = (int)std::thread::hardware_concurrency();
+		return (Count < 1 ? 4 : (Count > MAX_THREADS ? MAX_THREADS : Count)); //the number can be unknown (0)
+	}
+
+	void SetThreadCount(int Count)
+	{
+		//Limits how many threads (including the calling one) work on the jobs, 0 uses the default of one per logical processor
+		//The pool gets more threads if it has less than that (it never shrinks while in use)
+		if (Count <= 0) Count = GetDefaultThreadCount();
+		if (Count > MAX_THREADS) Count = MAX_THREADS;
+		if (!Pooled) Count = 1; //pool threads never see a slot outside of the pool
+		Slot->MaxHelpers = Count - 1;
+		if ((uint32_t)Count - 1 > SharedPool->WorkerCount) { std::lock_guard<std::mutex> Lock(PoolMutex); SharedPool->AddThreads(Count - 1); }
+	}
+
+	size_t GetThreadCount() const { return min((size_t)Slot->MaxHelpers, (size_t)SharedPool->WorkerCount) + 1; }
+
+	//Time until the job of the next call to StartNewJob or StartTileJob should be done (like the frame interval of the stream)
+	void SetFrameTime(uint32_t Microseconds) { FrameTime = Microseconds; }
+
+	//How the rows of a job map to the rows it reads from the output of a pre job, like the kernels do it: Scale source rows per row
+	//(or the vertical filter taps of Coeffs when resizing), counted from the bottom for YUV output and read in reverse with Flip
+	struct RowMap { size_t SrcHeight; int Scale; bool BottomUp, Flip; const ResizeCoeffs* Coeffs; };
+
+	void StartNewJob(const ProcessJob& NewJob, const ProcessJob* NewPreJob = NULL, const RowMap* NewMap = NULL)
+	{
+		//Split into chunks of rows that the threads claim one after another, so a thread that gets preempted (or wakes up late) only holds
+		//up the chunk it is working on instead of a fixed share of the frame. Chunks start on even rows so 4:2:0 YUV row pairs are never split
+		//With a pre job (the rotation) its chunks get claimed first, a chunk of the job then only waits for the ones producing the rows it reads
+		JobSlot& s = *Slot;
+		const size_t Threads = GetThreadCount();
+		s.Job = NewJob, s.Tiles = NULL;
+		s.ChunkRows = GetChunkRows(NewJob.RowEnd, Threads, GetMinChunkRows(NewJob)), s.PreChunkRows = s.PreChunks = 0;
+		if (NewPreJob)
+		{
+			s.PreJob = *NewPreJob, s.Map = *NewMap;
+			s.PreChunkRows = GetChunkRows(s.PreJob.RowEnd, Threads, MIN_CHUNK_ROWS), s.PreChunks = (s.PreJob.RowEnd + s.PreChunkRows - 1) / s.PreChunkRows;
+			if (s.PreChunks > s.PreDoneSize) { delete[] s.PreDone; s.PreDone = new std::atomic<int>[s.PreDoneSize = s.PreChunks]; }
+			for (size_t i = 0; i != s.PreChunks; i++) s.PreDone[i] = 0;
+		}
+		if (NewJob.Stats && !s.ThreadStats) s.ThreadStats = new ProcessStats[MAX_THREADS];
+		s.StatsUsed = 0;
+		RunChunks(s.PreChunks + (NewJob.RowEnd + s.ChunkRows - 1) / s.ChunkRows);
+
+		//Merge the statistics of the threads
+		if (NewJob.Stats) { NewJob.Stats->Clear(); for (size_t i = 0; i != MAX_THREADS; i++) if (s.StatsUsed & ((uint64_t)1 << i)) NewJob.Stats->Add(s.ThreadStats[i]); }
+	}
+
+	void StartTileJob(const ProcessJob& NewJob, const uint32_t* NewTiles, size_t NewTileCount)
+	{
+		//Run a job only on a sorted list of tiles of ProcessJob::TILE_ROWS rows, the chunks are made of a number of tiles instead of rows
+		UCASSERT(!NewJob.Stats);
+		JobSlot& s = *Slot;
+		s.Job = NewJob, s.Tiles = NewTiles, s.TileCount = NewTileCount, s.PreChunks = 0;
+		const size_t Threads = GetThreadCount();
+		s.ChunkTiles = max(max((size_t)1, NewTileCount / (Threads * CHUNKS_PER_THREAD)), min(GetMinChunkRows(NewJob) / ProcessJob::TILE_ROWS, NewTileCount / Threads));
+		RunChunks((NewTileCount + s.ChunkTiles - 1) / s.ChunkTiles);
+	}
+
+	static void GetSourceRows(const ProcessJob& Job, const RowMap& Map, size_t* Start, size_t* End)
+	{
+		//Rows are checked one by one as resizing can leave some of them outside of the letterboxed image area (which read nothing)
+		size_t First = Map.SrcHeight, Last = 0;
+		for (size_t y = Job.RowStart; y != Job.RowEnd; y++)
+		{
+			const size_t r = (Map.BottomUp ? Job.Height - 1 - y : y);
+			size_t s, e;
+			if (Map.Coeffs)
+			{
+				const int ir = (int)r - Map.Coeffs->ImgY;
+				if (ir < 0 || ir >= Map.Coeffs->ImgH) continue;
+				s = Map.Coeffs->StartY[ir], e = s + Map.Coeffs->TapsY;
+			}
+			else s = r * Map.Scale, e = s + Map.Scale;
+			if (Map.Flip) { const size_t t = s; s = Map.SrcHeight - e; e = Map.SrcHeight - t; }
+			First = min(First, s), Last = max(Last, e);
+		}
+		*Start = min(First, Last), *End = Last;
+	}
+
+private:
+	struct Parking
+	{
+		//Sleeping until a 32 bit value changes: a futex on Linux, WaitOnAddress on Windows 8 and newer (looked up at runtime as the
+		//filter also runs on older versions) and a condition variable otherwise, a wake up can be spurious so waiting needs a loop
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		#ifdef _WIN32
+		typedef BOOL (WINAPI *WaitOnAddressFunc)(volatile VOID* Address, PVOID CompareAddress, SIZE_T AddressSize, DWORD dwMilliseconds);
+		typedef VOID (WINAPI *WakeByAddressAllFunc)(PVOID Address);
+		WaitOnAddressFunc WaitOnAddressPtr;
+		WakeByAddressAllFunc WakeByAddressAllPtr;
+
+		Parking()
+		{
+			HMODULE KernelBase = GetModuleHandleA("kernelbase.dll");
+			WaitOnAddressPtr = (KernelBase ? (WaitOnAddressFunc)GetProcAddress(KernelBase, "WaitOnAddress") : NULL);
+			WakeByAddressAllPtr = (KernelBase ? (WakeByAddressAllFunc)GetProcAddress(KernelBase, "WakeByAddressAll") : NULL);
+			if (!WakeByAddressAllPtr) WaitOnAddressPtr = NULL;
+		}
+		#endif
+
+		void Wait(std::atomic<uint32_t>& Value, uint32_t Expected)
+		{
+			#if defined(__linux__)
+			syscall(SYS_futex, (uint32_t*)&Value, FUTEX_WAIT_PRIVATE, Expected, NULL, NULL, 0);
+			#else
+			#ifdef _WIN32
+			if (WaitOnAddressPtr) { WaitOnAddressPtr((volatile VOID*)&Value, &Expected, sizeof(Expected), INFINITE); return; }
+			#endif
+			std::unique_lock<std::mutex> Lock(Mutex);
+			while (Value == Expected) Condition.wait(Lock);
+			#endif
+		}
+
+		void WakeAll(std::atomic<uint32_t>& Value)
+		{
+			#if defined(__linux__)
+			syscall(SYS_futex, (uint32_t*)&Value, FUTEX_WAKE_PRIVATE, 0x7FFFFFFF, NULL, NULL, 0);
+			#else
+			#ifdef _WIN32
+			if (WakeByAddressAllPtr) { WakeByAddressAllPtr((PVOID)&Value); return; }
+			#endif
+			{ std::lock_guard<std::mutex> Lock(Mutex); } //a waiter is either before its check of the value or inside wait
+			Condition.notify_all();
+			#endif
+		}
+
+		void WaitForChange(std::atomic<uint32_t>& Value, uint32_t Expected, std::atomic<uint32_t>& Sleepers)
+		{
+			//The sleeper count is raised before checking the value again, so a thread changing the value after that check sees it and wakes us
+			Sleepers++;
+			if (Value == Expected) Wait(Value, Expected);
+			Sleepers--;
+		}
+	};
+
+	struct JobSlot
+	{
+		//The job of one ProcessWorkers, only changed by it while no chunks of it are left to claim or running
+		//Slots stay in the pool until it gets destroyed so a pool thread can look at any of them at any time
+		ProcessJob Job, PreJob;
+		RowMap Map;
+		const uint32_t* Tiles;
+		size_t TileCount, ChunkTiles, ChunkRows, PreChunkRows, PreChunks, PreDoneSize;
+		std::atomic<int>* PreDone; //set for every pre job chunk once its rows are done
+		ProcessStats* ThreadStats; //one per thread (the calling thread uses the last one) which are used when their bit is set in StatsUsed
+		std::atomic<uint64_t> StatsUsed, Deadline;
+		bool InUse; //guarded by PoolMutex
+
+		//Chunks get claimed by incrementing the lower half of NextChunk, the upper half holds the number of chunks of the job
+		//As both are in the same value, a thread that is still looking for work of an earlier job can never claim a chunk twice
+		//The calling thread waits for ChunksDone to reach the number of chunks, Helpers counts the pool threads working on the job
+		std::atomic<uint64_t> NextChunk;
+		std::atomic<uint32_t> ChunksDone, DoneSleepers, Helpers, MaxHelpers;
+		Parking Park;
+
+		JobSlot() : PreDoneSize(0), PreDone(NULL), ThreadStats(NULL), StatsUsed(0), Deadline(0), InUse(false), NextChunk(0), ChunksDone(0), DoneSleepers(0), Helpers(0), MaxHelpers(0) { }
+		~JobSlot() { delete[] PreDone; delete[] ThreadStats; }
+
+		bool HasChunks() const { const uint64_t c = NextChunk; return (uint32_t)c < (c >> 32); }
+
+		bool RunNextChunk(size_t Thread, ProcessScratch* Scratch)
+		{
+			const uint64_t Claim = NextChunk++;
+			const size_t Chunk = (size_t)(uint32_t)Claim, Total = (size_t)(Claim >> 32);
+			if (Chunk >= Total) return false;
+			RunChunk(Chunk, Thread, Scratch);
+			if (++ChunksDone == Total && DoneSleepers) Park.WakeAll(ChunksDone);
+			return true;
+		}
+
+		void RunChunk(size_t Chunk, size_t Thread, ProcessScratch* Scratch)
+		{
+			ProcessJob j = (Chunk < PreChunks ? PreJob : Job);
+			if (Tiles)
+			{
+				//Consecutive tiles get converted as one row range
+				const size_t Rows = j.RowEnd, TileEnd = min(TileCount, (Chunk + 1) * ChunkTiles);
+				for (size_t t = Chunk * ChunkTiles, e; t != TileEnd; t = e)
+				{
+					for (e = t + 1; e != TileEnd && Tiles[e] == Tiles[e-1] + 1; e++) {}
+					j.RowStart = Tiles[t] * ProcessJob::TILE_ROWS, j.RowEnd = min(Rows, (size_t)(Tiles[e-1] + 1) * ProcessJob::TILE_ROWS);
+					j.Execute(Scratch);
+				}
+				return;
+			}
+			if (Chunk < PreChunks)
+			{
+				j.RowStart = Chunk * PreChunkRows, j.RowEnd = min(j.RowEnd, j.RowStart + PreChunkRows);
+				j.Execute(Scratch);
+				PreDone[Chunk] = 1;
+				return;
+			}
+			Chunk -= PreChunks;
+			j.RowStart = Chunk * ChunkRows, j.RowEnd = min(j.RowEnd, j.RowStart + ChunkRows);
+			if (j.Stats)
+			{
+				const uint64_t Bit = (uint64_t)1 << Thread;
+				if (!(StatsUsed.fetch_or(Bit) & Bit)) ThreadStats[Thread].Clear();
+				j.Stats = &ThreadStats[Thread];
+			}
+			if (PreChunks)
+			{
+				//The pre job chunks were all claimed before this one so the threads working on them never wait for anything
+				size_t NeedStart, NeedEnd;
+				GetSourceRows(j, Map, &NeedStart, &NeedEnd);
+				for (size_t p = NeedStart / PreChunkRows; NeedStart != NeedEnd && p <= (NeedEnd - 1) / PreChunkRows; p++)
+					for (int Spin = 0; !PreDone[p]; Spin++) { if (Spin < 1000) _mm_pause(); else std::this_thread::yield(); }
+			}
+			j.Execute(Scratch);
+		}
+	};
+
+	struct Pool
+	{
+		//Idle threads wait for Generation to change (it gets increased for every new job), the sleeper count tells if anyone
+		//needs to be woken up so there are no system calls while the threads are spinning
+		std::thread Threads[MAX_THREADS - 1];
+		JobSlot Slots[MAX_JOBS];
+		std::atomic<uint32_t> WorkerCount, SlotCount, SpinLimit, Generation, WorkerSleepers;
+		std::atomic<bool> Quit;
+		Parking Park;
+		int Users; //guarded by PoolMutex
+
+		Pool() : WorkerCount(0), SlotCount(0), SpinLimit(0), Generation(0), WorkerSleepers(0), Quit(false), Users(0) { AddThreads(GetDefaultThreadCount() - 1); }
+
+		~Pool()
+		{
+			Quit = true, Generation++;
+			Park.WakeAll(Generation); //wake up all threads
+			for (uint32_t i = 0; i != WorkerCount; i++) Threads[i].join();
+		}
+
+		void AddThreads(uint32_t Count)
+		{
+			//Only called with PoolMutex locked
+			if (Count > MAX_THREADS - 1) Count = MAX_THREADS - 1;
+			for (uint32_t i = WorkerCount; i < Count; i++) Threads[i] = std::thread(WorkerThread, this, (size_t)i);
+			if (Count > WorkerCount) WorkerCount = Count;
+			SpinLimit = (WorkerCount + 1 <= std::thread::hardware_concurrency() ? MAX_SPIN : 0);
+		}
+
+		bool RunChunk(size_t Thread, uint32_t& NextSlot, ProcessScratch* Scratch)
+		{
+			//Pick the job with the earliest deadline that has chunks left and still can take a helper, starting the search
+			//after the slot of the last chunk this thread ran so jobs with the same deadline take turns
+			const uint32_t Count = SlotCount;
+			JobSlot* Best = NULL;
+			uint64_t BestDeadline = 0;
+			uint32_t BestSlot = 0;
+			for (uint32_t k = 0; k != Count; k++)
+			{
+				const uint32_t i = (NextSlot + k) % Count;
+				JobSlot& s = Slots[i];
+				if (!s.HasChunks() || s.Helpers >= s.MaxHelpers) continue;
+				const uint64_t Deadline = s.Deadline;
+				if (Best && Deadline >= BestDeadline) continue;
+				Best = &s, BestDeadline = Deadline, BestSlot = i;
+			}
+			if (!Best) return false;
+			NextSlot = BestSlot + 1;
+			if (++Best->Helpers <= Best->MaxHelpers) Best->RunNextChunk(Thread, Scratch);
+			Best->Helpers--;
+			return true;
+		}
+
+		static void WorkerThread(Pool* p, size_t Thread)
+		{
+			ProcessScratch Scratch; //kept for all jobs of the thread
+			for (uint32_t SpinLength = min((uint32_t)MIN_SPIN, (uint32_t)p->SpinLimit), NextSlot = 0;;)
+			{
+				const uint32_t Seen = p->Generation;
+				if (p->Quit) return;
+				if (p->RunChunk(Thread, NextSlot, &Scratch)) continue;
+
+				//Nothing to do, wait for a new job
+				uint32_t Current = Seen, Spin = 0;
+				for (; Current == Seen && Spin < SpinLength; Spin++) { _mm_pause(); Current = p->Generation; }
+				if (Current == Seen)
+				{
+					//Nothing came up while spinning, spin shorter next time and sleep until the generation changes
+					SpinLength = min(max(SpinLength / 2, (uint32_t)MIN_SPIN), (uint32_t)p->SpinLimit);
+					do p->Park.WaitForChange(p->Generation, Seen, p->WorkerSleepers); while (p->Generation == Seen);
+				}
+				else if (Spin) SpinLength = min(SpinLength * 2, (uint32_t)p->SpinLimit); //a job arrived while spinning
+			}
+		}
+	};
+
+	JobSlot* Slot;
+	bool Pooled; //false if Slot is not one of the pool (see AcquireSlot)
+	uint32_t FrameTime;
+	ProcessScratch CallerScratch; //used by the chunks of the calling thread
+	static std::mutex PoolMutex;
+	static Pool* SharedPool;
+
+	ProcessWorkers(const ProcessWorkers&);
+	ProcessWorkers& operator=(const ProcessWorkers&);
+
+	static JobSlot* AcquireSlot()
+	{
+		//The pool gets created with the first ProcessWorkers and destroyed with the last one (so never while unloading the DLL)
+		std::lock_guard<std::mutex> Lock(PoolMutex);
+		//Returns NULL if all slots are in use (the pool is still kept alive for the caller and needs ReleaseSlot with NULL)
+		if (!SharedPool) SharedPool = new Pool;
+		SharedPool->Users++;
+		uint32_t i = 0;
+		while (i != MAX_JOBS && SharedPool->Slots[i].InUse) i++;
+		if (i == MAX_JOBS) return NULL;
+		SharedPool->Slots[i].InUse = true;
+		if (i >= SharedPool->SlotCount) SharedPool->SlotCount = i + 1;
+		return &SharedPool->Slots[i];
+	}
+
+	static void ReleaseSlot(JobSlot* Slot)
+	{
+		std::lock_guard<std::mutex> Lock(PoolMutex);
+		if (Slot) Slot->InUse = false;
+		if (--SharedPool->Users) return;
+		delete SharedPool;
+		SharedPool = NULL;
+	}
+
+	static size_t GetMinChunkRows(const ProcessJob& Job)
+	{
+		//Every chunk of a resize job converts and scales the source rows of the filter taps of its first row again (the chunk before it
+		//already did that), chunks of these get large enough that this is at most an eighth of the source rows they read
+		if (!Job.Coeffs) return MIN_CHUNK_ROWS;
+		const ResizeCoeffs& rc = *Job.Coeffs;
+		return max((size_t)MIN_CHUNK_ROWS, (size_t)(8 * (rc.TapsY - 1)) * rc.ImgH / max(rc.SrcH, 1) + 1);
+	}
+
+	static size_t GetChunkRows(size_t Rows, size_t Threads, size_t MinRows)
+	{
+		//A few chunks per thread but not less than MinRows, unless that would leave a thread without a chunk (a tile hashing job has just one row per tile)
+		if (Threads == 1) return max(Rows, (size_t)2);
+		const size_t n = max(Rows / (Threads * CHUNKS_PER_THREAD), min(MinRows, Rows / Threads));
+		return max((n + 1) & ~(size_t)1, (size_t)2);
+	}
+
+	void RunChunks(size_t Total)
+	{
+		//Publish the job and notify pool threads of new work to do, the ones still spinning pick it up without a system call
+		JobSlot& s = *Slot;
+		Pool& p = *SharedPool;
+		s.Deadline = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() + FrameTime;
+		s.ChunksDone = 0;
+		s.NextChunk = (uint64_t)Total << 32;
+		if (s.MaxHelpers && p.WorkerCount) { p.Generation++; if (p.WorkerSleepers) p.Park.WakeAll(p.Generation); }
+
+		//Do work in the calling thread as well
+		while (s.RunNextChunk(MAX_THREADS - 1, &CallerScratch)) {}
+
+		//Wait for the chunks pool threads are still working on, they are short so this rarely needs to sleep
+		for (int Spin = 0;; Spin++)
+		{
+			const uint32_t Done = s.ChunksDone;
+			if (Done == Total) return;
+			if (Spin < (int)p.SpinLimit) _mm_pause();
+			else s.Park.WaitForChange(s.ChunksDone, Done, s.DoneSleepers);
+		}
+	}
+};
+
+std::mutex ProcessWorkers::PoolMutex;
+ProcessWorkers::Pool* ProcessWorkers::SharedPool = NULL;
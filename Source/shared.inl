@@ -8,12 +8,39 @@
 */
 
 #define _HAS_EXCEPTIONS 0
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <initguid.h>
+#endif
 #include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
 
 #define MAX_SHARED_IMAGE_SIZE (3840 * 2160 * 4 * sizeof(short)) //4K (RGBA max 16bit per pixel)
+#define SHARED_MEM_VERSION 0x55430002 //'UC' and the layout version of SharedMemHeader, needs to be increased with every change of the header
+
+static void StreamingCopy(void* dst, const void* src, size_t n, bool Fence = true)
+{
+	//Same as memcpy but with non-temporal stores which need 16 byte aligned addresses, the unaligned head and tail get written normally
+	//Without Fence the caller needs to do the sfence once it is done (like the conversion kernels do after all rows of a job)
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	const size_t Head = (n < (size_t)(-(intptr_t)d & 15) ? n : (size_t)(-(intptr_t)d & 15));
+	memcpy(d, s, Head);
+	d += Head, s += Head, n -= Head;
+	for (; n >= 64; n -= 64, d += 64, s += 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)s), b = _mm_loadu_si128((const __m128i*)(s + 16)), c = _mm_loadu_si128((const __m128i*)(s + 32)), e = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_stream_si128((__m128i*)d, a); _mm_stream_si128((__m128i*)(d + 16), b); _mm_stream_si128((__m128i*)(d + 32), c); _mm_stream_si128((__m128i*)(d + 48), e);
+	}
+	for (; n >= 16; n -= 16, d += 16, s += 16) _mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+	memcpy(d, s, n);
+	if (Fence) _mm_sfence();
+}
+
+//Everything above is also used by the kernel benchmark on platforms other than Windows, the shared memory itself is Windows only
+#ifdef _WIN32
 
 #if _DEBUG
 #define UCASSERT(cond) ((cond) ? ((void)0) : *(volatile int*)0 = 0xbad|(OutputDebugStringA("[FAILED ASSERT] " #cond "\n"),1))
@@ -40,12 +67,46 @@ struct SharedImageMemory
 	int32_t GetCapNum() { return m_CapNum; }
 	enum { MAX_CAPNUM = ('z' - '0') }; //see Open() for why this number
 	enum { RECEIVE_MAX_WAIT = 200 }; //How many milliseconds to wait for new frame
-	enum EFormat { FORMAT_UINT8, FORMAT_FP16_GAMMA, FORMAT_FP16_LINEAR };
-	enum EResizeMode { RESIZEMODE_DISABLED = 0, RESIZEMODE_LINEAR = 1 };
-	enum EMirrorMode { MIRRORMODE_DISABLED = 0, MIRRORMODE_HORIZONTALLY = 1 };
-	enum EReceiveResult { RECEIVERES_CAPTUREINACTIVE, RECEIVERES_NEWFRAME, RECEIVERES_OLDFRAME };
+	enum EFormat { FORMAT_UINT8, FORMAT_FP16_GAMMA, FORMAT_FP16_LINEAR, FORMAT_BGRA8, FORMAT_RGB10A2_GAMMA, FORMAT_RGB10A2_LINEAR, FORMAT_R11G11B10F_GAMMA, FORMAT_R11G11B10F_LINEAR, FORMAT_FP32_GAMMA, FORMAT_FP32_LINEAR };
+	enum EResizeMode { RESIZEMODE_DISABLED = 0, RESIZEMODE_LINEAR = 1, RESIZEMODE_AREA = 2, RESIZEMODE_LANCZOS = 3 };
+	enum EMirrorMode { MIRRORMODE_DISABLED = 0, MIRRORMODE_HORIZONTALLY = 1, MIRRORMODE_VERTICALLY = 2, MIRRORMODE_ROTATE_180 = 3, MIRRORMODE_ROTATE_90 = 4, MIRRORMODE_ROTATE_270 = 5 }; //rotation is clockwise
+	enum EAlphaMode { ALPHAMODE_KEEP = 0, ALPHAMODE_PREMULTIPLY = 1, ALPHAMODE_UNPREMULTIPLY = 2 }; //unpremultiply is for premultiplied sources and gives straight alpha
+	enum EReceiveResult { RECEIVERES_CAPTUREINACTIVE, RECEIVERES_NEWFRAME, RECEIVERES_OLDFRAME, RECEIVERES_VERSIONMISMATCH };
+
+	struct FrameStats
+	{
+		//Statistics of the last frame output by the capture device, computed while converting it if requested by the sender
+		//Luma is BT.709 weighted 8 bit RGB (before any YUV conversion), alpha is only measured with ARGB output (otherwise all pixels are opaque)
+		uint32_t frames;  //number of frames output with statistics (counts up with every frame including repeated ones)
+		uint32_t repeats; //number of frames in a row that were output again without a new frame from Unity
+		uint32_t width, height;
+		uint32_t transparent, opaque; //number of pixels with alpha 0 and 255
+		uint32_t tiles, dirtytiles; //with the capture device only converting changed tiles, the number of output tiles and how many of them changed
+		uint64_t lumasum, alphasum;
+		uint32_t histogram[256]; //number of pixels for each luma value
+	};
+
+	static size_t GetLastLevelCacheSize()
+	{
+		//Size of the largest (last level) data or unified cache, frames above this size get copied and converted with non-temporal stores
+		static size_t CacheSize = 0;
+		if (CacheSize) return CacheSize;
+		DWORD InfoSize = 0;
+		GetLogicalProcessorInformation(NULL, &InfoSize);
+		SYSTEM_LOGICAL_PROCESSOR_INFORMATION* Info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(InfoSize ? InfoSize : 1);
+		BYTE MaxLevel = 0;
+		size_t Size = 0;
+		if (InfoSize && GetLogicalProcessorInformation(Info, &InfoSize))
+			for (DWORD i = 0; i != InfoSize / sizeof(*Info); i++)
+				if (Info[i].Relationship == RelationCache && Info[i].Cache.Type != CacheInstruction && Info[i].Cache.Level >= MaxLevel)
+					Size = (Info[i].Cache.Level > MaxLevel ? 0 : Size) + Info[i].Cache.Size, MaxLevel = Info[i].Cache.Level; //sum up caches of the same level (i.e. per CCX)
+		free(Info);
+		return (CacheSize = (Size ? Size : 8 * 1024 * 1024)); //assume a common size if the system doesn't say
+	}
+
+	static int GetBytesPerPixel(EFormat format) { return (format == FORMAT_FP16_GAMMA || format == FORMAT_FP16_LINEAR ? 8 : (format == FORMAT_FP32_GAMMA || format == FORMAT_FP32_LINEAR ? 16 : 4)); }
 
-	typedef void (*ReceiveCallbackFunc)(int width, int height, int stride, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, int timeout, uint8_t* buffer, void* callback_data);
+	typedef void (*ReceiveCallbackFunc)(int width, int height, int stride, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, EAlphaMode alphamode, int timeout, uint8_t* buffer, uint32_t sequence, FrameStats* stats, void* callback_data);
 
 	EReceiveResult Receive(ReceiveCallbackFunc callback, void* callback_data)
 	{
@@ -55,7 +116,17 @@ struct SharedImageMemory
 		bool IsNewFrame = (WaitForSingleObject(m_hSentFrameEvent, RECEIVE_MAX_WAIT) == WAIT_OBJECT_0);
 
 		WaitForSingleObject(m_hMutex, INFINITE); //lock mutex
-		callback(m_pSharedBuf->width, m_pSharedBuf->height, m_pSharedBuf->stride, (EFormat)m_pSharedBuf->format, (EResizeMode)m_pSharedBuf->resizemode, (EMirrorMode)m_pSharedBuf->mirrormode, m_pSharedBuf->timeout, m_pSharedBuf->data, callback_data);
+		if (m_pSharedBuf->version != SHARED_MEM_VERSION)
+		{
+			//A sender from before the header was versioned wrote its frame data over the version, reset it to wait for a matching sender
+			m_pSharedBuf->version = SHARED_MEM_VERSION;
+			m_pSharedBuf->width = 0;
+			ReleaseMutex(m_hMutex); //unlock mutex
+			return RECEIVERES_VERSIONMISMATCH;
+		}
+		FrameStats* stats = (m_pSharedBuf->wantstats ? &m_pSharedBuf->stats : NULL); //filled in by the callback
+		if (stats) stats->repeats = (IsNewFrame ? 0 : stats->repeats + 1);
+		callback(m_pSharedBuf->width, m_pSharedBuf->height, m_pSharedBuf->stride, (EFormat)m_pSharedBuf->format, (EResizeMode)m_pSharedBuf->resizemode, (EMirrorMode)m_pSharedBuf->mirrormode, (EAlphaMode)m_pSharedBuf->alphamode, m_pSharedBuf->timeout, m_pSharedBuf->data, m_pSharedBuf->sequence, stats, callback_data);
 		ReleaseMutex(m_hMutex); //unlock mutex
 
 		return (IsNewFrame ? RECEIVERES_NEWFRAME : RECEIVERES_OLDFRAME);
@@ -67,7 +138,7 @@ struct SharedImageMemory
 	}
 
 	enum ESendResult { SENDRES_TOOLARGE, SENDRES_WARN_FRAMESKIP, SENDRES_OK };
-	ESendResult Send(int width, int height, int stride, DWORD DataSize, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, int timeout, const uint8_t* buffer)
+	ESendResult Send(int width, int height, int stride, DWORD DataSize, EFormat format, EResizeMode resizemode, EMirrorMode mirrormode, EAlphaMode alphamode, bool wantstats, int timeout, const uint8_t* buffer)
 	{
 		UCASSERT(buffer);
 		UCASSERT(m_pSharedBuf);
@@ -80,8 +151,12 @@ struct SharedImageMemory
 		m_pSharedBuf->format = format;
 		m_pSharedBuf->resizemode = resizemode;
 		m_pSharedBuf->mirrormode = mirrormode;
+		m_pSharedBuf->alphamode = alphamode;
+		m_pSharedBuf->wantstats = wantstats;
 		m_pSharedBuf->timeout = timeout;
-		memcpy(m_pSharedBuf->data, buffer, DataSize);
+		m_pSharedBuf->sequence++;
+		if (DataSize > GetLastLevelCacheSize()) StreamingCopy(m_pSharedBuf->data, buffer, DataSize); //keep the caches of the render thread
+		else memcpy(m_pSharedBuf->data, buffer, DataSize);
 		ReleaseMutex(m_hMutex); //unlock mutex
 
 		SetEvent(m_hSentFrameEvent);
@@ -90,6 +165,16 @@ struct SharedImageMemory
 		return (DidSkipFrame ? SENDRES_WARN_FRAMESKIP : SENDRES_OK);
 	}
 
+	bool GetStats(FrameStats* stats)
+	{
+		//Copy the statistics of the last frame output by the capture device, false if there are none yet
+		if (!m_pSharedBuf) return false;
+		WaitForSingleObject(m_hMutex, INFINITE); //lock mutex
+		*stats = m_pSharedBuf->stats;
+		ReleaseMutex(m_hMutex); //unlock mutex
+		return (stats->frames != 0);
+	}
+
 private:
 	bool Open(bool ForReceiving)
 	{
@@ -137,8 +222,22 @@ private:
 		m_pSharedBuf = (SharedMemHeader*)MapViewOfFile(m_hSharedFile, FILE_MAP_WRITE, 0, 0, 0);
 		if (!m_pSharedBuf) return false;
 
+		//Refuse mappings of a different header version (i.e. a filter and plugin DLL of different releases) instead of misreading the fields
+		//A receiver can also get an older smaller mapping if a sender still keeps that open, the sender only checks the version set by the receiver
+		MEMORY_BASIC_INFORMATION MemInfo;
+		if (ForReceiving ? (!VirtualQuery(m_pSharedBuf, &MemInfo, sizeof(MemInfo)) || MemInfo.RegionSize < sizeof(SharedMemHeader) + MAX_SHARED_IMAGE_SIZE) : (m_pSharedBuf->version != SHARED_MEM_VERSION))
+		{
+			UnmapViewOfFile(m_pSharedBuf);
+			CloseHandle(m_hSharedFile);
+			m_pSharedBuf = NULL;
+			m_hSharedFile = NULL;
+			return false;
+		}
+
 		if (ForReceiving && m_pSharedBuf->maxSize != MAX_SHARED_IMAGE_SIZE)
 			m_pSharedBuf->maxSize = MAX_SHARED_IMAGE_SIZE;
+		if (ForReceiving && m_pSharedBuf->version != SHARED_MEM_VERSION)
+			m_pSharedBuf->version = SHARED_MEM_VERSION;
 
 		return true;
 	}
@@ -153,6 +252,12 @@ private:
 		int resizemode;
 		int mirrormode;
 		int timeout;
+		//Fields up to here keep the layout of the unversioned header of older releases, new fields get added after the version
+		uint32_t version; //SHARED_MEM_VERSION, set by the receiver
+		int alphamode;
+		int wantstats;
+		uint32_t sequence; //counts up with every sent frame so the receiver can tell if the data changed since it last converted it
+		FrameStats stats;
 		uint8_t data[1];
 	};
 
@@ -163,3 +268,5 @@ private:
 	HANDLE m_hSharedFile;
 	SharedMemHeader* m_pSharedBuf;
 };
+
+#endif
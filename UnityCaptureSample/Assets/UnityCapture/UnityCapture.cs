@@ -34,8 +34,9 @@ using UnityEngine;
 public class UnityCapture : MonoBehaviour
 {
     public enum ECaptureDevice { CaptureDevice1 = 0, CaptureDevice2 = 1, CaptureDevice3 = 2, CaptureDevice4 = 3, CaptureDevice5 = 4, CaptureDevice6 = 5, CaptureDevice7 = 6, CaptureDevice8 = 7, CaptureDevice9 = 8, CaptureDevice10 = 9 }
-    public enum EResizeMode { Disabled = 0, LinearResize = 1 }
-    public enum EMirrorMode { Disabled = 0, MirrorHorizontally = 1 }
+    public enum EResizeMode { Disabled = 0, LinearResize = 1, AreaResize = 2, LanczosResize = 3 }
+    public enum EMirrorMode { Disabled = 0, MirrorHorizontally = 1, FlipVertically = 2, Rotate180 = 3, Rotate90 = 4, Rotate270 = 5 }
+    public enum EAlphaMode { Unchanged = 0, Premultiply = 1, Unpremultiply = 2 }
     public enum ECaptureSendResult
     {
         SUCCESS = 0,
@@ -51,10 +52,27 @@ public class UnityCapture : MonoBehaviour
         ERROR_INVALIDCAPTUREINSTANCEPTR = 200
     };
 
+    [System.Runtime.InteropServices.StructLayout(System.Runtime.InteropServices.LayoutKind.Sequential)]
+    public struct FrameStats
+    {
+        public uint Frames; // Number of frames output with statistics so far
+        public uint Repeats; // Number of frames in a row that were output again without a new frame (frozen output)
+        public uint Width, Height; // Capture output resolution
+        public uint TransparentPixels, OpaquePixels; // Pixels with alpha 0 and 255 (only measured with ARGB output, otherwise all pixels are opaque)
+        public uint Tiles, DirtyTiles; // With 'Skip unchanged' enabled on the capture device, the number of output tiles and how many of them changed
+        public ulong LumaSum, AlphaSum;
+        [System.Runtime.InteropServices.MarshalAs(System.Runtime.InteropServices.UnmanagedType.ByValArray, SizeConst = 256)] public uint[] Histogram; // Number of pixels for each luma value (0 to 255)
+
+        public float AverageLuma { get { return (Width * Height != 0 ? (float)(LumaSum / (255.0 * Width * Height)) : 0f); } }
+        public float AlphaCoverage { get { return (Width * Height != 0 ? (float)(AlphaSum / (255.0 * Width * Height)) : 0f); } }
+    }
+
     [Tooltip("Capture device index")] public ECaptureDevice CaptureDevice = ECaptureDevice.CaptureDevice1;
     [Tooltip("Scale image if Unity and capture resolution don't match (can introduce frame dropping, not recommended)")] public EResizeMode ResizeMode = EResizeMode.Disabled;
     [Tooltip("How many milliseconds to wait for a new frame until sending is considered to be stopped")] public int Timeout = 1000;
     [Tooltip("Mirror captured output image")] public EMirrorMode MirrorMode = EMirrorMode.Disabled;
+    [Tooltip("Convert between straight and premultiplied alpha (use Unpremultiply if the rendering is premultiplied, most receiving applications expect straight alpha)")] public EAlphaMode AlphaMode = EAlphaMode.Unchanged;
+    [Tooltip("Have the capture device compute luma and alpha statistics of its output frames (see GetFrameStats)")] public bool FrameStatistics = false;
     [Tooltip("Introduce a frame of latency in favor of frame rate")] public bool DoubleBuffering = false;
     [Tooltip("Check to enable VSync during capturing")] public bool EnableVSync = false;
     [Tooltip("Set the desired render target frame rate")] public int TargetFrameRate = 60;
@@ -148,6 +166,15 @@ public class UnityCapture : MonoBehaviour
         _requestScreenshot = true;
     }
 
+    // Statistics of the last frame output by the capture device (with FrameStatistics enabled), false if there are none
+    // This can be used to detect black (low AverageLuma), transparent (low AlphaCoverage) or frozen (Repeats counting up) output
+    public bool GetFrameStats(out FrameStats Stats)
+    {
+        if (CaptureInterface != null) return CaptureInterface.GetFrameStats(out Stats);
+        Stats = new FrameStats();
+        return false;
+    }
+
     void OnDestroy()
     {
         if (CaptureInterface != null)
@@ -167,7 +194,7 @@ public class UnityCapture : MonoBehaviour
 
         if (_requestScreenshot)
         {
-            CaptureInterface.SetTexture(source, Timeout, DoubleBuffering, ResizeMode, MirrorMode, _requestedScreenshotFileName);
+            CaptureInterface.SetTexture(source, Timeout, DoubleBuffering, ResizeMode, MirrorMode, AlphaMode, FrameStatistics, _requestedScreenshotFileName);
             _requestScreenshot = false;
             StartCoroutine(CaptureInterface.TakeScreenshot());
         }
@@ -176,7 +203,7 @@ public class UnityCapture : MonoBehaviour
         {
             // This method is always called, in case of an unespected error, it may help to fall back in a working situation
             // Another idea should be to start the recording process manually and call this method only one (when the result is RET_SUCCESS) and never call it again
-            CaptureInterface.SetTexture(source, Timeout, DoubleBuffering, ResizeMode, MirrorMode);
+            CaptureInterface.SetTexture(source, Timeout, DoubleBuffering, ResizeMode, MirrorMode, AlphaMode, FrameStatistics);
             ECaptureSendResult result = CaptureInterface.LastResult(); // Retreiving back the result
             switch (result)
             {
@@ -186,7 +213,7 @@ public class UnityCapture : MonoBehaviour
                 case ECaptureSendResult.ERROR_UNSUPPORTEDGRAPHICSDEVICE: Debug.LogError("[UnityCapture] Unsupported graphics device (only D3D11/GL/GLCORE/GLES supported)"); break;
                 case ECaptureSendResult.ERROR_PARAMETER: Debug.LogError("[UnityCapture] Input parameter error"); break;
                 case ECaptureSendResult.ERROR_TOOLARGERESOLUTION: Debug.LogError("[UnityCapture] Render resolution is too large to send to capture device"); break;
-                case ECaptureSendResult.ERROR_TEXTUREFORMAT: Debug.LogError("[UnityCapture] Render texture format is unsupported (only basic non-HDR (ARGB32) and HDR (FP16/ARGB Half) formats are supported)"); break;
+                case ECaptureSendResult.ERROR_TEXTUREFORMAT: Debug.LogError("[UnityCapture] Render texture format is unsupported (supported are ARGB32, BGRA32, ARGB2101010, RGB111110Float, ARGBHalf and ARGBFloat)"); break;
                 case ECaptureSendResult.ERROR_READTEXTURE: Debug.LogError("[UnityCapture] Error while reading texture image data"); break;
                 case ECaptureSendResult.ERROR_READTEXTUREDATA: Debug.LogError("[UnityCapture] Error while reading texture buffer data"); break;
                 case ECaptureSendResult.ERROR_TEXTUREHANDLE: Debug.LogError("[UnityCapture] Texture handle error"); break;
@@ -201,8 +228,9 @@ public class UnityCapture : MonoBehaviour
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static System.IntPtr CaptureCreateInstance(int CapNum);
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static ECaptureSendResult GetLastResult();
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void CaptureDeleteInstance(System.IntPtr instance);
-        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void SetTextureFromUnity(System.IntPtr instance, System.IntPtr nativetexture, int Timeout, bool UseDoubleBuffering, EResizeMode ResizeMode, EMirrorMode MirrorMode, bool IsLinearColorSpace, int width, int height);
-        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void PrepareScreenshot(System.IntPtr instance, System.IntPtr nativetexture, int Timeout, bool UseDoubleBuffering, EResizeMode ResizeMode, EMirrorMode MirrorMode, bool IsLinearColorSpace, int width, int height, byte[] fileName);
+        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void SetTextureFromUnity(System.IntPtr instance, System.IntPtr nativetexture, int Timeout, bool UseDoubleBuffering, EResizeMode ResizeMode, EMirrorMode MirrorMode, EAlphaMode AlphaMode, bool CollectStats, bool IsLinearColorSpace, int width, int height);
+        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static void PrepareScreenshot(System.IntPtr instance, System.IntPtr nativetexture, int Timeout, bool UseDoubleBuffering, EResizeMode ResizeMode, EMirrorMode MirrorMode, EAlphaMode AlphaMode, bool CollectStats, bool IsLinearColorSpace, int width, int height, byte[] fileName);
+        [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] [return: System.Runtime.InteropServices.MarshalAs(System.Runtime.InteropServices.UnmanagedType.I1)] extern static bool CaptureGetFrameStats(System.IntPtr instance, out FrameStats stats);
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static System.IntPtr GetTakeScreenshotEventFunc();
         [System.Runtime.InteropServices.DllImport("UnityCapturePlugin")] extern static System.IntPtr GetRenderEventFunc();
         System.IntPtr CaptureInstance;
@@ -253,7 +281,9 @@ public class UnityCapture : MonoBehaviour
         /// <param name="DoubleBuffering"></param>
         /// <param name="ResizeMode"></param>
         /// <param name="MirrorMode"></param>
-        public void SetTexture(Texture Source, int Timeout = 1000, bool DoubleBuffering = false, EResizeMode ResizeMode = EResizeMode.Disabled, EMirrorMode MirrorMode = EMirrorMode.Disabled, string fileName = null)
+        /// <param name="AlphaMode"></param>
+        /// <param name="CollectStats"></param>
+        public void SetTexture(Texture Source, int Timeout = 1000, bool DoubleBuffering = false, EResizeMode ResizeMode = EResizeMode.Disabled, EMirrorMode MirrorMode = EMirrorMode.Disabled, EAlphaMode AlphaMode = EAlphaMode.Unchanged, bool CollectStats = false, string fileName = null)
         {
             if (CaptureInstance != System.IntPtr.Zero)
             {
@@ -263,16 +293,27 @@ public class UnityCapture : MonoBehaviour
                 }
                 if (fileName == null)
                 {
-                    SetTextureFromUnity(CaptureInstance, _cachedTexturePtr, Timeout, DoubleBuffering, ResizeMode, MirrorMode, QualitySettings.activeColorSpace == ColorSpace.Linear, Source.width, Source.height);
+                    SetTextureFromUnity(CaptureInstance, _cachedTexturePtr, Timeout, DoubleBuffering, ResizeMode, MirrorMode, AlphaMode, CollectStats, QualitySettings.activeColorSpace == ColorSpace.Linear, Source.width, Source.height);
                 }
                 else
                 {
                     byte[] bytes = System.Text.Encoding.Unicode.GetBytes(fileName);
-                    PrepareScreenshot(CaptureInstance, _cachedTexturePtr, Timeout, DoubleBuffering, ResizeMode, MirrorMode, QualitySettings.activeColorSpace == ColorSpace.Linear, Source.width, Source.height, bytes);
+                    PrepareScreenshot(CaptureInstance, _cachedTexturePtr, Timeout, DoubleBuffering, ResizeMode, MirrorMode, AlphaMode, CollectStats, QualitySettings.activeColorSpace == ColorSpace.Linear, Source.width, Source.height, bytes);
                 }
             }
         }
 
+        /// <summary>
+        /// Gets the statistics of the last frame output by the capture device (only collected while sending with CollectStats)
+        /// </summary>
+        /// <param name="Stats"></param>
+        /// <returns>False if there are no statistics yet</returns>
+        public bool GetFrameStats(out FrameStats Stats)
+        {
+            Stats = new FrameStats();
+            return (CaptureInstance != System.IntPtr.Zero && CaptureGetFrameStats(CaptureInstance, out Stats));
+        }
+
         /// <summary>
         /// Returns the last result of the last IssuePluginEvent call
         /// </summary>